@@ -0,0 +1,127 @@
+#include "buffer_pool.h"
+
+buffer_pool::buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        m_free[i] = NULL;
+        m_free_count[i] = 0;
+    }
+}
+
+// 进程退出时释放所有空闲块
+buffer_pool::~buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        while (m_free[i])
+        {
+            free_node *node = m_free[i];
+            m_free[i] = node->next;
+            ::free(node);
+        }
+    }
+}
+
+buffer_pool *buffer_pool::get_instance()
+{
+    static buffer_pool pool;
+    return &pool;
+}
+
+// size所属的级别 (向上取整到2的幂)
+int buffer_pool::size_class(int size)
+{
+    int c = 0;
+    while ((MIN_SIZE << c) < size)
+        ++c;
+    return c;
+}
+
+// 借用缓冲区 (优先从空闲链表中取，没有再向系统申请)
+char *buffer_pool::alloc(int size, int *cap)
+{
+    if (size > MAX_SIZE)
+        return NULL;
+
+    int c = size_class(size);
+    *cap = MIN_SIZE << c;
+
+    m_lock[c].lock();
+    free_node *node = m_free[c];
+    if (node)
+    {
+        m_free[c] = node->next;
+        m_free_count[c]--;
+    }
+    m_lock[c].unlock();
+
+    if (node)
+        return (char *)node;
+    return (char *)malloc(*cap);
+}
+
+// 归还缓冲区 (空闲块过多时直接还给系统，避免突发流量之后长期占用内存)
+void buffer_pool::release(char *buf, int cap)
+{
+    if (!buf)
+        return;
+
+    int c = size_class(cap);
+    free_node *node = (free_node *)buf;
+
+    m_lock[c].lock();
+    if (m_free_count[c] < MAX_FREE)
+    {
+        node->next = m_free[c];
+        m_free[c] = node;
+        m_free_count[c]++;
+        node = NULL;
+    }
+    m_lock[c].unlock();
+
+    if (node)
+        ::free(node);
+}
+
+// 保证当前块至少还有need字节剩余空间
+bool buffer_chain::reserve(int need)
+{
+    if (avail() >= need)
+        return true;
+    if (m_count == MAX_CHUNKS)
+        return false;
+
+    // 正在生成的数据需要搬到新块中
+    int keep = pending();
+    int cap;
+    char *buf = buffer_pool::get_instance()->alloc(keep + need, &cap);
+    if (!buf)
+        return false;
+    if (keep > 0)
+        memcpy(buf, start(), keep);
+
+    // 当前块中只有正在生成的数据 (没有被iovec引用)，直接换成新块
+    if (m_count > 0 && 0 == m_start)
+    {
+        m_count--;
+        buffer_pool::get_instance()->release((char *)m_chunks[m_count].iov_base, m_chunks[m_count].iov_len);
+    }
+
+    m_chunks[m_count].iov_base = buf;
+    m_chunks[m_count].iov_len = cap;
+    m_count++;
+    m_len = keep;
+    m_start = 0;
+    return true;
+}
+
+// 归还所有块
+void buffer_chain::clear()
+{
+    for (int i = 0; i < m_count; ++i)
+        buffer_pool::get_instance()->release((char *)m_chunks[i].iov_base, m_chunks[i].iov_len);
+    m_count = 0;
+    m_len = 0;
+    m_start = 0;
+}
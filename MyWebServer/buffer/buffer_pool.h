@@ -0,0 +1,85 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "../lock/locker.h"
+
+// 分级缓冲区池 (按2KB、4KB、...、64KB分级，每级维护一个空闲链表。连接只在有数据收发时借用缓冲区，空闲时归还，不再为每个连接常驻固定大小的缓冲区)
+class buffer_pool
+{
+public:
+    static const int MIN_SHIFT = 11;                                // 最小一级为2KB
+    static const int CLASS_NUM = 6;                                 // 共6级: 2KB ~ 64KB
+    static const int MIN_SIZE = 1 << MIN_SHIFT;
+    static const int MAX_SIZE = 1 << (MIN_SHIFT + CLASS_NUM - 1);
+    static const int MAX_FREE = 1024;                               // 每级最多缓存的空闲块数 (超出的直接还给系统)
+
+    // 局部静态变量 (单例模式)
+    static buffer_pool *get_instance();
+
+    char *alloc(int size, int *cap);   // 借用一块容量不小于size的缓冲区，cap为实际容量 (size超过MAX_SIZE时返回NULL)
+    void release(char *buf, int cap);  // 归还缓冲区 (cap为借用时得到的容量)
+
+private:
+    buffer_pool();
+    ~buffer_pool();
+
+    static int size_class(int size);   // size所属的级别
+
+    struct free_node
+    {
+        free_node *next;
+    };
+    free_node *m_free[CLASS_NUM];      // 各级的空闲链表 (空闲块的开头用作链表指针)
+    int m_free_count[CLASS_NUM];       // 各级的空闲块数
+    locker m_lock[CLASS_NUM];          // 各级一把锁 (工作线程、子反应堆线程都会借用和归还)
+};
+
+// 写缓冲区链 (由缓冲区池中的块串成。当前块空间不足时借用新块，并把正在生成的数据一起搬过去，保证每段数据连续存放；
+// 之前的块在发送完毕前保持不变，其中的数据可直接作为writev的iovec)
+class buffer_chain
+{
+public:
+    static const int MAX_CHUNKS = 16;
+
+    buffer_chain() : m_count(0), m_len(0), m_start(0) {}
+    ~buffer_chain() { clear(); }
+
+    char *start()      // 正在生成的数据的起始位置
+    {
+        return m_count > 0 ? (char *)m_chunks[m_count - 1].iov_base + m_start : NULL;
+    }
+    int pending()      // 正在生成的数据长度
+    {
+        return m_len - m_start;
+    }
+    char *tail()       // 当前块中可继续写入的位置
+    {
+        return m_count > 0 ? (char *)m_chunks[m_count - 1].iov_base + m_len : NULL;
+    }
+    int avail()        // 当前块的剩余空间
+    {
+        return m_count > 0 ? (int)m_chunks[m_count - 1].iov_len - m_len : 0;
+    }
+    void commit(int n) // 在tail处写入了n字节
+    {
+        m_len += n;
+    }
+    void seal()        // 正在生成的数据已交给iovec，之后写入的数据另起一段
+    {
+        m_start = m_len;
+    }
+
+    bool reserve(int need);   // 保证当前块至少还有need字节剩余空间 (不足时借用新块，块数或大小超出上限时返回false)
+    void clear();             // 归还所有块
+
+private:
+    struct iovec m_chunks[MAX_CHUNKS];   // 已借用的块 (iov_base为块地址，iov_len为块容量)
+    int m_count;                         // 块数
+    int m_len;                           // 当前块已写入的字节数
+    int m_start;                         // 正在生成的数据在当前块中的起始位置
+};
+
+#endif
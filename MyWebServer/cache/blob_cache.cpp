@@ -0,0 +1,526 @@
+#include "blob_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+blob_cache::blob_cache() : m_budget(0), m_window(0), m_protected(0)
+{
+    for (int i = 0; i < SHARD_NUM; ++i)
+    {
+        shard &s = m_shards[i];
+        for (int j = 0; j < BUCKET_NUM; ++j)
+            s.buckets[j] = NULL;
+        for (int j = 0; j < SEGMENT_NUM; ++j)
+        {
+            s.head[j].prev = s.head[j].next = &s.head[j];
+            s.bytes[j] = 0;
+        }
+        memset(s.sketch, 0, sizeof(s.sketch));
+        s.samples = 0;
+        memset(&s.stats, 0, sizeof(s.stats));
+    }
+}
+
+blob_cache *blob_cache::get_instance()
+{
+    static blob_cache cache;
+    return &cache;
+}
+
+void blob_cache::init(long long budget)
+{
+    m_budget = budget / SHARD_NUM;
+    m_window = m_budget / 100;
+    m_protected = (m_budget - m_window) * 80 / 100;
+
+    pthread_t tid;
+    if (m_budget > 0 && pthread_create(&tid, NULL, compress_worker, this) == 0)
+        pthread_detach(tid);
+}
+
+// 第i个哈希函数对应的计数器 (分片由哈希值的低位决定，这里取乘法后的高位)
+int blob_cache::sketch_index(unsigned hash, int i)
+{
+    static const unsigned seeds[4] = {0x9e3779b1u, 0x85ebca6bu, 0xc2b2ae35u, 0x27d4eb2fu};
+    return (hash * seeds[i]) >> 20 & (SKETCH_WIDTH - 1);
+}
+
+void blob_cache::record(shard &s, unsigned hash)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        unsigned char &c = s.sketch[sketch_index(hash, i)];
+        if (c < 15)
+            c++;
+    }
+    if (++s.samples >= SKETCH_SAMPLE)
+    {
+        for (int i = 0; i < SKETCH_WIDTH; ++i)
+            s.sketch[i] >>= 1;
+        s.samples /= 2;
+    }
+}
+
+int blob_cache::frequency(shard &s, unsigned hash)
+{
+    int f = 15;
+    for (int i = 0; i < 4; ++i)
+    {
+        int c = s.sketch[sketch_index(hash, i)];
+        if (c < f)
+            f = c;
+    }
+    return f;
+}
+
+void blob_cache::push_front(shard &s, blob *b, int segment)
+{
+    blob *head = &s.head[segment];
+    b->segment = segment;
+    b->next = head->next;
+    b->prev = head;
+    head->next->prev = b;
+    head->next = b;
+    s.bytes[segment] += b->size;
+}
+
+void blob_cache::remove(shard &s, blob *b)
+{
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+    s.bytes[b->segment] -= b->size;
+}
+
+void blob_cache::unlink(shard &s, blob *b)
+{
+    blob **p = &s.buckets[b->hash / SHARD_NUM % BUCKET_NUM];
+    while (*p != b)
+        p = &(*p)->hnext;
+    *p = b->hnext;
+    remove(s, b);
+}
+
+blob *blob_cache::lookup(const char *path)
+{
+    if (0 == m_budget)
+        return NULL;
+
+    unsigned h = file_cache::hash_path(path);
+    shard &s = m_shards[h % SHARD_NUM];
+    blob *found = NULL;
+
+    s.lock.lock();
+    record(s, h);
+    blob *b = s.buckets[h / SHARD_NUM % BUCKET_NUM];
+    while (b && (b->hash != h || b->path != path))
+        b = b->hnext;
+    if (b && b->expire <= file_cache::now_ms())
+        b = NULL;    // 已过期，按未命中处理 (由file_cache重新检查文件后经admit续期或替换)
+    if (b)
+    {
+        // 试用区中的项再次被访问时升入保护区，保护区超出预算时把最久未使用的项降回试用区
+        int segment = PROBATION == b->segment ? PROTECTED : b->segment;
+        remove(s, b);
+        push_front(s, b, segment);
+        while (s.bytes[PROTECTED] > m_protected)
+        {
+            blob *demoted = s.head[PROTECTED].prev;
+            remove(s, demoted);
+            push_front(s, demoted, PROBATION);
+        }
+        b->ref++;
+        s.stats.hits++;
+        found = b;
+    }
+    else
+    {
+        s.stats.misses++;
+    }
+    s.lock.unlock();
+    return found;
+}
+
+blob *blob_cache::admit(const file_entry *file)
+{
+    long long size = file->st.st_size;
+    if (0 == m_budget || size <= 0 || size > MAX_BLOB || size > m_budget - m_window)
+        return NULL;
+
+    // 门卫: 只访问过一次的文件不复制 (lookup已记录本次访问)
+    shard &s = m_shards[file->hash % SHARD_NUM];
+    s.lock.lock();
+    int freq = frequency(s, file->hash);
+    if (freq < 2)
+    {
+        s.lock.unlock();
+        return NULL;
+    }
+    // 已过期的项对应的文件没有变化时直接续期，不必重新读取和压缩
+    blob *cur = s.buckets[file->hash / SHARD_NUM % BUCKET_NUM];
+    while (cur && (cur->hash != file->hash || cur->path != file->path))
+        cur = cur->hnext;
+    if (cur && cur->st.st_ino == file->st.st_ino && cur->st.st_size == file->st.st_size &&
+        cur->st.st_mtim.tv_sec == file->st.st_mtim.tv_sec && cur->st.st_mtim.tv_nsec == file->st.st_mtim.tv_nsec)
+    {
+        cur->expire = file_cache::now_ms() + file_cache::TTL_MS;
+        cur->ref++;
+        s.lock.unlock();
+        return cur;
+    }
+    // 先按访问频率预判准入结果，会被拒绝的文件不读取也不压缩 (否则每次未命中都白白复制和压缩一遍)
+    if (!would_admit(s, file->hash, size))
+    {
+        s.stats.rejections++;
+        s.lock.unlock();
+        return NULL;
+    }
+    s.lock.unlock();
+
+    blob *b = new blob;
+    memset(b->variant, 0, sizeof(b->variant));
+    if (!make_variant(b->variant[ENC_IDENTITY], file->header, size))
+    {
+        delete b;
+        return NULL;
+    }
+    char *body = b->variant[ENC_IDENTITY].body;
+    if (file->addr)
+    {
+        memcpy(body, file->addr, size);
+    }
+    else
+    {
+        for (long long n = 0; n < size;)
+        {
+            ssize_t ret = pread(file->fd, body + n, size - n, n);
+            if (ret <= 0)
+            {
+                free(b->variant[ENC_IDENTITY].data);
+                delete b;
+                return NULL;
+            }
+            n += ret;
+        }
+    }
+    b->size = size;
+
+    b->path = file->path;
+    b->hash = file->hash;
+    b->st = file->st;
+    b->type = file->type;
+    memcpy(b->etag, file->etag, sizeof(b->etag));
+    b->etag_len = file->etag_len;
+    memcpy(b->validators, file->validators, sizeof(b->validators));
+    b->expire = file_cache::now_ms() + file_cache::TTL_MS;
+    b->ready = 1 << ENC_IDENTITY;
+    b->ref = 2;    // 缓存和调用者各持有一个引用
+
+    blob **bucket = &s.buckets[b->hash / SHARD_NUM % BUCKET_NUM];
+    blob *dropped = NULL;
+
+    s.lock.lock();
+    // 其他线程同时缓存了同一文件，用新生成的替换
+    blob *old = *bucket;
+    while (old && (old->hash != b->hash || old->path != b->path))
+        old = old->hnext;
+    if (old)
+    {
+        unlink(s, old);
+        old->hnext = dropped;
+        dropped = old;
+    }
+
+    b->hnext = *bucket;
+    *bucket = b;
+    push_front(s, b, WINDOW);
+    evict_window(s, dropped);
+    // 文本类文件留在缓存中时交给压缩线程 (每个文件只在进入缓存时压缩一次)，本次及压缩完成前的响应发送原文
+    bool queue = size >= MIN_COMPRESS && compressible(b->path.c_str(), b->path.size()) && cached(s, b);
+    if (queue)
+        b->ref++;    // 压缩线程持有一个引用
+    s.lock.unlock();
+
+    if (queue)
+    {
+        m_compress_lock.lock();
+        bool full = m_compress_queue.size() >= MAX_COMPRESS_QUEUE;
+        if (!full)
+            m_compress_queue.push_back(b);
+        m_compress_lock.unlock();
+        if (full)
+            release(b);    // 队列已满，只缓存原文
+        else
+            m_compress_stat.post();
+    }
+
+    while (dropped)
+    {
+        blob *next = dropped->hnext;
+        release(dropped);
+        dropped = next;
+    }
+    return b;
+}
+
+bool blob_cache::make_variant(blob_variant &v, const char *header, long long size)
+{
+    int len = strlen(header);
+    v.data = (char *)malloc(len + size);
+    if (!v.data)
+        return false;
+    memcpy(v.data, header, len);
+    v.header = v.data;
+    v.header_len = len;
+    v.body = v.data + len;
+    v.size = size;
+    return true;
+}
+
+const blob_variant *blob_cache::select(const blob *b, int accepted)
+{
+    const blob_variant *best = &b->variant[ENC_IDENTITY];
+    accepted &= b->ready.load(std::memory_order_acquire);    // 只考虑已生成的版本
+    for (int e = ENC_IDENTITY + 1; e < ENC_NUM; ++e)
+    {
+        const blob_variant &v = b->variant[e];
+        if ((accepted & (1 << e)) && v.size > 0 && v.size < best->size)
+            best = &v;
+    }
+    return best;
+}
+
+// 比evict_window的实际处理略为乐观 (不计窗口区中更早的项进入主区占用的空间)，预判通过后仍由evict_window做最终决定
+bool blob_cache::would_admit(shard &s, unsigned hash, long long size)
+{
+    // 放得进窗口区的新内容总是先留在窗口区 (被挤出窗口区的是其中更早的项)
+    if (size <= m_window)
+        return true;
+
+    // 否则它自己就是窗口区的淘汰对象: 依次与evict_window将要淘汰的受害者 (先试用区、后保护区，从最久未使用的开始) 比较访问频率
+    long long need = s.bytes[PROBATION] + s.bytes[PROTECTED] + size - (m_budget - m_window);
+    int freq = frequency(s, hash);
+    int segment = PROBATION;
+    blob *victim = s.head[PROBATION].prev;
+    while (need > 0)
+    {
+        if (victim == &s.head[segment])
+        {
+            if (PROTECTED == segment)
+                break;
+            segment = PROTECTED;
+            victim = s.head[PROTECTED].prev;
+            continue;
+        }
+        if (freq <= frequency(s, victim->hash))
+            return false;
+        need -= victim->size;
+        victim = victim->prev;
+    }
+    return true;
+}
+
+void blob_cache::evict_window(shard &s, blob *&dropped)
+{
+    long long main = m_budget - m_window;
+    while (s.bytes[WINDOW] > m_window)
+    {
+        blob *candidate = s.head[WINDOW].prev;
+        long long size = candidate->size;
+        bool admitted = true;
+
+        // 主区放不下时，候选项与试用区 (试用区为空时为保护区) 中最久未使用的项比较访问频率，更高才淘汰受害者，否则拒绝候选项
+        while (s.bytes[PROBATION] + s.bytes[PROTECTED] + size > main)
+        {
+            int segment = s.head[PROBATION].prev != &s.head[PROBATION] ? PROBATION : PROTECTED;
+            blob *victim = s.head[segment].prev;
+            if (frequency(s, candidate->hash) <= frequency(s, victim->hash))
+            {
+                admitted = false;
+                break;
+            }
+            unlink(s, victim);
+            victim->hnext = dropped;
+            dropped = victim;
+            s.stats.evictions++;
+        }
+
+        if (admitted)
+        {
+            remove(s, candidate);
+            push_front(s, candidate, PROBATION);
+            s.stats.admissions++;
+        }
+        else
+        {
+            unlink(s, candidate);
+            candidate->hnext = dropped;
+            dropped = candidate;
+            s.stats.rejections++;
+        }
+    }
+}
+
+bool blob_cache::cached(shard &s, const blob *b)
+{
+    const blob *p = s.buckets[b->hash / SHARD_NUM % BUCKET_NUM];
+    while (p && p != b)
+        p = p->hnext;
+    return p != NULL;
+}
+
+void *blob_cache::compress_worker(void *arg)
+{
+    blob_cache *cache = (blob_cache *)arg;
+    while (true)
+    {
+        cache->m_compress_stat.wait();
+        cache->m_compress_lock.lock();
+        if (cache->m_compress_queue.empty())
+        {
+            cache->m_compress_lock.unlock();
+            continue;
+        }
+        blob *b = cache->m_compress_queue.front();
+        cache->m_compress_queue.pop_front();
+        cache->m_compress_lock.unlock();
+
+        cache->compress_blob(b);
+        release(b);
+    }
+    return NULL;
+}
+
+// 压缩在锁外进行 (原文生成后不再修改，可以直接读取)，压缩后不足原大小90%的才保留。
+// 追加版本时缓存项可能已被替换或淘汰，也可能加上后超出预算，这些情况下丢弃压缩结果
+void blob_cache::compress_blob(blob *b)
+{
+    shard &s = m_shards[b->hash % SHARD_NUM];
+    const blob_variant &identity = b->variant[ENC_IDENTITY];
+    for (int e = ENC_IDENTITY + 1; e < ENC_NUM; ++e)
+    {
+        s.lock.lock();
+        bool alive = cached(s, b);
+        s.lock.unlock();
+        if (!alive)
+            return;    // 已经不在缓存中，不必继续压缩
+
+        int len;
+        char *z = compress(e, identity.body, identity.size, &len);
+        if (!z)
+            continue;
+        char header[384];
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length:%d\r\nContent-Type:%s\r\nContent-Encoding:%s\r\nVary:Accept-Encoding\r\nETag:\"%s-%s\"\r\n%s",
+                 len, b->type, encoding_name(e), b->etag, encoding_name(e), b->validators);
+        blob_variant v;
+        if (len >= identity.size * 9 / 10 || !make_variant(v, header, len))
+        {
+            free(z);
+            continue;
+        }
+        memcpy(v.body, z, len);
+        free(z);
+
+        // 窗口区中的项变大后可能需要交给准入策略；主区中的项只在主区放得下时才追加
+        blob *dropped = NULL;
+        s.lock.lock();
+        bool fits = cached(s, b) && b->size + len <= m_budget - m_window &&
+                    (WINDOW == b->segment || s.bytes[PROBATION] + s.bytes[PROTECTED] + len <= m_budget - m_window);
+        if (fits)
+        {
+            b->variant[e] = v;
+            b->size += len;
+            s.bytes[b->segment] += len;
+            b->ready.fetch_or(1 << e, std::memory_order_release);
+            if (WINDOW == b->segment)
+                evict_window(s, dropped);
+        }
+        s.lock.unlock();
+        if (!fits)
+            free(v.data);
+
+        while (dropped)
+        {
+            blob *next = dropped->hnext;
+            release(dropped);
+            dropped = next;
+        }
+    }
+}
+
+void blob_cache::release(blob *b)
+{
+    if (--b->ref > 0)
+        return;
+    for (int e = 0; e < ENC_NUM; ++e)
+        free(b->variant[e].data);
+    delete b;
+}
+
+void blob_cache::invalidate(const char *path)
+{
+    if (0 == m_budget)
+        return;
+
+    unsigned h = file_cache::hash_path(path);
+    shard &s = m_shards[h % SHARD_NUM];
+
+    s.lock.lock();
+    blob *b = s.buckets[h / SHARD_NUM % BUCKET_NUM];
+    while (b && (b->hash != h || b->path != path))
+        b = b->hnext;
+    if (b)
+        unlink(s, b);
+    s.lock.unlock();
+
+    if (b)
+        release(b);
+}
+
+void blob_cache::invalidate_all()
+{
+    for (int i = 0; i < SHARD_NUM; ++i)
+    {
+        shard &s = m_shards[i];
+        blob *dropped = NULL;
+        s.lock.lock();
+        for (int j = 0; j < SEGMENT_NUM; ++j)
+        {
+            while (s.head[j].next != &s.head[j])
+            {
+                blob *b = s.head[j].next;
+                unlink(s, b);
+                b->hnext = dropped;
+                dropped = b;
+            }
+        }
+        s.lock.unlock();
+
+        while (dropped)
+        {
+            blob *next = dropped->hnext;
+            release(dropped);
+            dropped = next;
+        }
+    }
+}
+
+blob_stats blob_cache::stats()
+{
+    blob_stats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < SHARD_NUM; ++i)
+    {
+        shard &s = m_shards[i];
+        s.lock.lock();
+        total.hits += s.stats.hits;
+        total.misses += s.stats.misses;
+        total.admissions += s.stats.admissions;
+        total.rejections += s.stats.rejections;
+        total.evictions += s.stats.evictions;
+        total.bytes += s.bytes[WINDOW] + s.bytes[PROBATION] + s.bytes[PROTECTED];
+        s.lock.unlock();
+    }
+    return total;
+}
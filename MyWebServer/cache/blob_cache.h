@@ -0,0 +1,129 @@
+#ifndef BLOB_CACHE_H
+#define BLOB_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <list>
+#include "../lock/locker.h"
+#include "file_cache.h"
+#include "compress.h"
+
+// 文件的一种内容编码 (响应头和内容一次分配)
+struct blob_variant
+{
+    char *data;                       // [响应头][内容]，不可用时为NULL
+    char *header;                     // 预先生成的响应头 (不含Date和Connection，发送时与它们一起复制到写缓冲区)
+    int header_len;
+    char *body;
+    long long size;                   // 内容的字节数 (0表示没有这种编码)
+};
+
+// 缓存在内存中的文件 (多个连接共享，引用计数归零时释放)。文本类文件进入缓存后由后台线程压缩，压缩版本生成前按原文发送，
+// 之后按请求的Accept-Encoding选择。除了追加压缩版本以外生成后不再修改
+struct blob
+{
+    std::string path;                 // 完整路径 (缓存的键)
+    unsigned hash;
+    struct stat st;                   // 文件信息
+    const char *type;                 // 以下与file_entry相同 (压缩版本的ETag另加"-编码名"后缀)
+    char etag[48];
+    int etag_len;
+    char validators[128];
+    blob_variant variant[ENC_NUM];    // 各编码的响应 (原文ENC_IDENTITY总是存在)
+    std::atomic<int> ready;           // 已生成的编码的位掩码 (1 << ENCODING。压缩版本写好后才置位，读取者据此判断能否使用)
+    long long size;                   // 各编码内容的字节数之和 (计入缓存预算)
+    long long expire;                 // 到期时间 (毫秒)
+    std::atomic<int> ref;
+
+    int segment;                      // 所在的区 (blob_cache::SEGMENT)
+    blob *hnext;                      // 同一哈希桶中的下一项
+    blob *prev;                       // 所在区的LRU链表 (表头为最近使用的)
+    blob *next;
+};
+
+// 缓存统计
+struct blob_stats
+{
+    long long hits;          // 命中次数
+    long long misses;        // 未命中次数
+    long long admissions;    // 进入主区的次数
+    long long rejections;    // 被准入策略拒绝的次数 (候选项的访问频率不高于受害者)
+    long long evictions;     // 被淘汰的次数
+    long long bytes;         // 当前缓存的文件内容字节数 (含压缩后的版本)
+};
+
+// 静态文件内存缓存 (W-TinyLFU: 每个分片按字节预算分为窗口区(1%)和主区，主区为分段LRU (试用区20%、保护区80%)。
+// 新内容先进入窗口区，从窗口区淘汰时与试用区中最久未使用的项比较Count-Min Sketch估计的访问频率，频率更高才进入主区，
+// 因此批量访问冷门文件时不会把热点文件挤出去。只访问过一次的文件不复制到内存 (门卫)，仍由file_cache映射或sendfile发送)
+class blob_cache
+{
+public:
+    static const int SHARD_NUM = 16;
+    static const int BUCKET_NUM = 256;              // 每个分片的哈希桶数
+    static const int SKETCH_WIDTH = 4096;           // 每个分片的频率计数器数 (4位计数器，最大15)
+    static const int SKETCH_SAMPLE = SKETCH_WIDTH * 10;    // 每记录这么多次访问后所有计数器减半，使频率随时间衰减
+    static const int MAX_BLOB = 1 << 20;            // 可缓存的最大文件 (1MB)
+    static const int MIN_COMPRESS = 256;            // 小于该大小的文件不压缩 (压缩节省的字节不抵响应头中多出的字段)
+    static const int MAX_COMPRESS_QUEUE = 256;      // 等待压缩的缓存项上限 (超出时只缓存原文)
+
+    enum SEGMENT
+    {
+        WINDOW = 0,
+        PROBATION,
+        PROTECTED,
+        SEGMENT_NUM
+    };
+
+    // 局部静态变量 (单例模式)
+    static blob_cache *get_instance();
+
+    void init(long long budget);                    // 设置字节预算 (0表示不缓存)，并启动压缩线程
+
+    blob *lookup(const char *path);                 // 查找未过期的缓存项 (增加引用计数)，未命中返回NULL。命中与否都记录一次访问
+    blob *admit(const file_entry *file);            // 未命中后尝试缓存该文件 (增加引用计数)，不满足条件 (过大、只访问过一次、读取失败) 时返回NULL
+    static void release(blob *b);                   // 释放一个引用
+    static const blob_variant *select(const blob *b, int accepted);    // 可接受的编码 (accepted_encodings的结果) 中内容最小的版本
+
+    void invalidate(const char *path);              // 删除路径对应的缓存项
+    void invalidate_all();
+    blob_stats stats();
+
+private:
+    blob_cache();
+
+    struct shard
+    {
+        locker lock;
+        blob *buckets[BUCKET_NUM];
+        blob head[SEGMENT_NUM];                 // 各区LRU链表的哨兵
+        long long bytes[SEGMENT_NUM];           // 各区的字节数
+        unsigned char sketch[SKETCH_WIDTH];     // Count-Min Sketch (4个哈希函数共用一个计数器数组)
+        int samples;                            // 上次衰减后记录的访问次数
+        blob_stats stats;
+    };
+
+    static int sketch_index(unsigned hash, int i);
+    static void record(shard &s, unsigned hash);    // 记录一次访问
+    static int frequency(shard &s, unsigned hash);  // 估计的访问频率
+    static bool make_variant(blob_variant &v, const char *header, long long size);    // 复制响应头，并为内容分配空间
+    static void push_front(shard &s, blob *b, int segment);
+    static void remove(shard &s, blob *b);          // 从LRU链表中摘除
+    void unlink(shard &s, blob *b);                 // 从分片中摘除 (调用者负责释放缓存持有的引用)
+    bool would_admit(shard &s, unsigned hash, long long size);    // 预判新内容进入窗口区后能否留在缓存中 (与evict_window的决策一致，只读取不修改)
+    void evict_window(shard &s, blob *&dropped);
+    static bool cached(shard &s, const blob *b);   // b是否仍在分片中 (没有被替换、淘汰或失效)
+    static void *compress_worker(void *arg);       // 压缩线程: 依次为队列中的缓存项生成压缩版本
+    void compress_blob(blob *b);    // 窗口区超出预算时，把多出的项交给准入策略 (被淘汰或拒绝的项经hnext串到dropped上，由调用者在解锁后释放)
+
+    shard m_shards[SHARD_NUM];
+    long long m_budget;                 // 每个分片的字节预算
+    long long m_window;                 // 窗口区预算
+    long long m_protected;              // 保护区预算
+
+    std::list<blob *> m_compress_queue; // 等待压缩的缓存项 (各持有一个引用)
+    locker m_compress_lock;
+    sem m_compress_stat;                // 队列中的项数
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+const char *encoding_name(int encoding)
+{
+    static const char *names[ENC_NUM] = {"identity", "gzip", "br"};
+    return encoding >= 0 && encoding < ENC_NUM ? names[encoding] : "identity";
+}
+
+bool compressible(const char *path, int len)
+{
+    static const char *exts[] = {".html", ".htm", ".css", ".js", ".json", ".txt", ".xml", ".svg"};
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i)
+    {
+        int n = strlen(exts[i]);
+        if (len > n && strcasecmp(path + len - n, exts[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// 编码名对应的ENCODING (不区分大小写)，不支持的编码返回-1，'*'返回ENC_NUM
+static int encoding_id(const char *name, int len)
+{
+    if (1 == len && '*' == name[0])
+        return ENC_NUM;
+    if ((4 == len && strncasecmp(name, "gzip", 4) == 0) || (6 == len && strncasecmp(name, "x-gzip", 6) == 0))
+        return ENC_GZIP;
+    if (2 == len && strncasecmp(name, "br", 2) == 0)
+        return ENC_BR;
+    if (8 == len && strncasecmp(name, "identity", 8) == 0)
+        return ENC_IDENTITY;
+    return -1;
+}
+
+// q值是否为0 ("0"、"0."、"0.000"等)
+static bool zero_qvalue(const char *p, const char *end)
+{
+    if (p == end || *p != '0')
+        return false;
+    for (++p; p < end && ('.' == *p || '0' == *p); ++p)
+        ;
+    return p == end;
+}
+
+int accepted_encodings(const char *value, int len)
+{
+    int listed = 0, accepted = 0;
+    bool star = false;
+    const char *p = value, *end = value + len;
+    while (p < end)
+    {
+        // 每一项为 编码名[;q=值]，以','分隔
+        const char *item_end = (const char *)memchr(p, ',', end - p);
+        if (!item_end)
+            item_end = end;
+        const char *name = p;
+        while (name < item_end && (' ' == *name || '\t' == *name))
+            ++name;
+        const char *name_end = name;
+        while (name_end < item_end && ';' != *name_end && ' ' != *name_end && '\t' != *name_end)
+            ++name_end;
+
+        bool zero = false;
+        const char *q = (const char *)memchr(name_end, ';', item_end - name_end);
+        if (q)
+        {
+            for (++q; q < item_end && (' ' == *q || '\t' == *q); ++q)
+                ;
+            if (item_end - q > 2 && ('q' == (q[0] | 0x20)) && '=' == q[1])
+            {
+                const char *v = q + 2, *v_end = item_end;
+                while (v_end > v && (' ' == v_end[-1] || '\t' == v_end[-1]))
+                    --v_end;
+                zero = zero_qvalue(v, v_end);
+            }
+        }
+
+        int id = encoding_id(name, name_end - name);
+        if (ENC_NUM == id)
+            star = !zero;
+        else if (id >= 0)
+        {
+            listed |= 1 << id;
+            if (!zero)
+                accepted |= 1 << id;
+        }
+        p = item_end + 1;
+    }
+    if (star)
+        accepted |= ((1 << ENC_NUM) - 1) & ~listed;
+    return accepted;
+}
+
+// gzip格式 (windowBits为15+16)，压缩级别9 (只在缓存时压缩一次)
+static char *compress_gzip(const char *src, int len, int *out_len)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+
+    int cap = deflateBound(&zs, len);
+    char *out = (char *)malloc(cap);
+    if (out)
+    {
+        zs.next_in = (Bytef *)src;
+        zs.avail_in = len;
+        zs.next_out = (Bytef *)out;
+        zs.avail_out = cap;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END)
+        {
+            *out_len = zs.total_out;
+        }
+        else
+        {
+            free(out);
+            out = NULL;
+        }
+    }
+    deflateEnd(&zs);
+    return out;
+}
+
+#ifdef HAVE_BROTLI
+// brotli质量9 (11的压缩率略高，但大文件要耗时数百毫秒，而只有一个压缩线程，会推迟之后进入缓存的文件的压缩)
+static char *compress_br(const char *src, int len, int *out_len)
+{
+    size_t cap = BrotliEncoderMaxCompressedSize(len);
+    char *out = (char *)malloc(cap);
+    if (!out)
+        return NULL;
+    if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t *)src, &cap, (uint8_t *)out))
+    {
+        free(out);
+        return NULL;
+    }
+    *out_len = cap;
+    return out;
+}
+#endif
+
+char *compress(int encoding, const char *src, int len, int *out_len)
+{
+    switch (encoding)
+    {
+    case ENC_GZIP:
+        return compress_gzip(src, len, out_len);
+#ifdef HAVE_BROTLI
+    case ENC_BR:
+        return compress_br(src, len, out_len);
+#endif
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+// 内容编码 (按压缩率从低到高排列)
+enum ENCODING
+{
+    ENC_IDENTITY = 0,
+    ENC_GZIP,
+    ENC_BR,          // 编译时定义HAVE_BROTLI才会生成
+    ENC_NUM
+};
+
+const char *encoding_name(int encoding);            // Content-Encoding字段的取值
+bool compressible(const char *path, int len);       // 按扩展名判断文件是否值得压缩 (文本类文件)
+int accepted_encodings(const char *value, int len);  // 解析Accept-Encoding字段值，返回可接受的编码的位掩码 (1 << ENCODING，q=0的编码不可接受，'*'代表未列出的编码)
+char *compress(int encoding, const char *src, int len, int *out_len);    // 压缩为指定编码，返回malloc分配的结果 (不支持该编码或失败时返回NULL)
+
+#endif
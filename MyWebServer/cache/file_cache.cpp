@@ -0,0 +1,358 @@
+#include "file_cache.h"
+#include "blob_cache.h"
+#include "../http/http_date.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+long long file_cache::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+file_cache::file_cache() : m_inotify_fd(-1)
+{
+    for (int i = 0; i < SHARD_NUM; ++i)
+    {
+        shard &s = m_shards[i];
+        for (int j = 0; j < BUCKET_NUM; ++j)
+            s.buckets[j] = NULL;
+        s.head.prev = s.head.next = &s.head;
+        s.count = 0;
+    }
+}
+
+file_cache *file_cache::get_instance()
+{
+    static file_cache cache;
+    return &cache;
+}
+
+// FNV-1a
+unsigned file_cache::hash_path(const char *path)
+{
+    unsigned h = 2166136261u;
+    for (; *path; ++path)
+        h = (h ^ (unsigned char)*path) * 16777619u;
+    return h;
+}
+
+bool file_cache::init(const char *root)
+{
+    m_root = root;
+    m_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (m_inotify_fd < 0)
+        return false;
+
+    // 文件内容或属性变化、被删除、被改名 (编辑器保存文件时常见的方式) 都需要失效
+    uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    pthread_t tid;
+    if (inotify_add_watch(m_inotify_fd, root, mask) < 0 || pthread_create(&tid, NULL, watch_worker, this) != 0)
+    {
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+const char *file_cache::content_type(const char *path, int len)
+{
+    static const char *types[][2] = {
+        {".html", "text/html; charset=utf-8"},
+        {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "application/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".xml", "text/xml; charset=utf-8"},
+        {".svg", "image/svg+xml"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".png", "image/png"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".mp4", "video/mp4"},
+        {".webm", "video/webm"},
+        {".mp3", "audio/mpeg"},
+        {".pdf", "application/pdf"},
+        {".woff2", "font/woff2"},
+    };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        int n = strlen(types[i][0]);
+        if (len > n && strcasecmp(path + len - n, types[i][0]) == 0)
+            return types[i][1];
+    }
+    return "application/octet-stream";
+}
+
+static bool longer_prefix(const std::pair<std::string, int> &a, const std::pair<std::string, int> &b)
+{
+    return a.first.size() > b.first.size();
+}
+
+bool file_cache::set_max_age(const char *rules)
+{
+    m_max_age.clear();
+    const char *p = rules;
+    while (*p)
+    {
+        const char *end = strchr(p, ',');
+        if (!end)
+            end = p + strlen(p);
+        const char *eq = (const char *)memchr(p, '=', end - p);
+        if (!eq || eq == p || '/' != *p)
+            return false;
+        char *num_end;
+        long seconds = strtol(eq + 1, &num_end, 10);
+        if (num_end != end || num_end == eq + 1 || seconds < 0)
+            return false;
+        m_max_age.push_back(std::make_pair(std::string(p, eq - p), (int)seconds));
+        p = *end ? end + 1 : end;
+    }
+    std::stable_sort(m_max_age.begin(), m_max_age.end(), longer_prefix);
+    return true;
+}
+
+int file_cache::max_age(const char *path)
+{
+    if (m_max_age.empty() || strncmp(path, m_root.c_str(), m_root.size()) != 0)
+        return -1;
+    const char *url = path + m_root.size();
+    for (size_t i = 0; i < m_max_age.size(); ++i)
+    {
+        if (strncmp(url, m_max_age[i].first.c_str(), m_max_age[i].first.size()) == 0)
+            return m_max_age[i].second;
+    }
+    return -1;
+}
+
+void *file_cache::watch_worker(void *arg)
+{
+    ((file_cache *)arg)->watch();
+    return NULL;
+}
+
+// 阻塞读取inotify事件，使对应的缓存项失效
+void file_cache::watch()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        int n = read(m_inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        for (char *p = buf; p < buf + n;)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                invalidate_all();    // 事件队列溢出丢失了事件，或根目录本身被删除、移走 (此后只依靠TTL)
+                blob_cache::get_instance()->invalidate_all();
+            }
+            else if (ev->len > 0)
+            {
+                std::string path = m_root + "/" + ev->name;
+                invalidate(path.c_str());
+                blob_cache::get_instance()->invalidate(path.c_str());
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+file_entry *file_cache::lookup(const char *path)
+{
+    unsigned h = hash_path(path);
+    shard &s = m_shards[h % SHARD_NUM];
+    file_entry *found = NULL, *expired = NULL;
+
+    s.lock.lock();
+    file_entry *entry = s.buckets[h / SHARD_NUM % BUCKET_NUM];
+    while (entry && (entry->hash != h || entry->path != path))
+        entry = entry->hnext;
+    if (entry)
+    {
+        if (entry->expire <= now_ms())
+        {
+            unlink(s, entry);    // 已过期，由调用者重新stat并加载
+            expired = entry;
+        }
+        else
+        {
+            // 移到LRU链表头部
+            entry->prev->next = entry->next;
+            entry->next->prev = entry->prev;
+            entry->next = s.head.next;
+            entry->prev = &s.head;
+            s.head.next->prev = entry;
+            s.head.next = entry;
+            entry->ref++;
+            found = entry;
+        }
+    }
+    s.lock.unlock();
+
+    if (expired)
+        release(expired);
+    return found;
+}
+
+file_entry *file_cache::load(const char *path, const struct stat &st, int map_threshold)
+{
+    int fd = -1;
+    char *addr = NULL;
+    if (st.st_size > 0)
+    {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return NULL;
+        if (map_threshold < 0 || st.st_size < map_threshold)
+        {
+            addr = (char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            fd = -1;
+            if (addr == MAP_FAILED)
+                return NULL;
+        }
+    }
+
+    file_entry *entry = new file_entry;
+    entry->path = path;
+    entry->hash = hash_path(path);
+    entry->st = st;
+    entry->fd = fd;
+    entry->addr = addr;
+    // 条件请求使用的校验值 (文件被替换或修改后inode、大小或修改时间至少有一项变化)
+    entry->etag_len = snprintf(entry->etag, sizeof(entry->etag), "%lx-%llx-%llx", (unsigned long)st.st_ino, (unsigned long long)st.st_size,
+                               (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+    char date[http_date::LEN + 1];
+    http_date::format(st.st_mtime, date);
+    date[http_date::LEN] = '\0';
+    entry->validators_len = snprintf(entry->validators, sizeof(entry->validators), "Last-Modified:%s\r\n", date);
+    int age = max_age(path);
+    if (age >= 0)
+        entry->validators_len += snprintf(entry->validators + entry->validators_len, sizeof(entry->validators) - entry->validators_len, "Cache-Control:max-age=%d\r\n", age);
+    // 文本类文件在内存缓存中另有压缩版本，原文的响应也需带上Vary字段，使中间缓存按Accept-Encoding区分
+    int path_len = strlen(path);
+    entry->type = content_type(path, path_len);
+    entry->header_len = snprintf(entry->header, sizeof(entry->header), "HTTP/1.1 200 OK\r\nContent-Length:%lld\r\nContent-Type:%s\r\nAccept-Ranges:bytes\r\n%sETag:\"%s\"\r\n%s",
+                                 (long long)st.st_size, entry->type, compressible(path, path_len) ? "Vary:Accept-Encoding\r\n" : "", entry->etag, entry->validators);
+    entry->expire = now_ms() + TTL_MS;
+    entry->ref = 2;    // 缓存和调用者各持有一个引用
+
+    shard &s = m_shards[entry->hash % SHARD_NUM];
+    file_entry **bucket = &s.buckets[entry->hash / SHARD_NUM % BUCKET_NUM];
+    file_entry *old = NULL, *evicted = NULL;
+
+    s.lock.lock();
+    // 同一路径已有缓存项 (其他线程同时加载了它，或它已过期)，用新加载的替换
+    old = *bucket;
+    while (old && (old->hash != entry->hash || old->path != entry->path))
+        old = old->hnext;
+    if (old)
+        unlink(s, old);
+    // 分片已满时淘汰最久未使用的项
+    else if (s.count >= MAX_ENTRIES / SHARD_NUM)
+    {
+        evicted = s.head.prev;
+        unlink(s, evicted);
+    }
+
+    entry->hnext = *bucket;
+    *bucket = entry;
+    entry->next = s.head.next;
+    entry->prev = &s.head;
+    s.head.next->prev = entry;
+    s.head.next = entry;
+    s.count++;
+    s.lock.unlock();
+
+    if (old)
+        release(old);
+    if (evicted)
+        release(evicted);
+    return entry;
+}
+
+void file_cache::release(file_entry *entry)
+{
+    if (--entry->ref > 0)
+        return;
+    if (entry->fd >= 0)
+        close(entry->fd);
+    if (entry->addr)
+        munmap(entry->addr, entry->st.st_size);
+    delete entry;
+}
+
+void file_cache::unlink(shard &s, file_entry *entry)
+{
+    file_entry **p = &s.buckets[entry->hash / SHARD_NUM % BUCKET_NUM];
+    while (*p != entry)
+        p = &(*p)->hnext;
+    *p = entry->hnext;
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    s.count--;
+}
+
+void file_cache::invalidate(const char *path)
+{
+    unsigned h = hash_path(path);
+    shard &s = m_shards[h % SHARD_NUM];
+
+    s.lock.lock();
+    file_entry *entry = s.buckets[h / SHARD_NUM % BUCKET_NUM];
+    while (entry && (entry->hash != h || entry->path != path))
+        entry = entry->hnext;
+    if (entry)
+        unlink(s, entry);
+    s.lock.unlock();
+
+    if (entry)
+        release(entry);
+}
+
+void file_cache::invalidate_all()
+{
+    for (int i = 0; i < SHARD_NUM; ++i)
+    {
+        shard &s = m_shards[i];
+        s.lock.lock();
+        file_entry *list = NULL;
+        while (s.head.next != &s.head)
+        {
+            file_entry *entry = s.head.next;
+            unlink(s, entry);
+            entry->hnext = list;
+            list = entry;
+        }
+        s.lock.unlock();
+
+        while (list)
+        {
+            file_entry *entry = list;
+            list = entry->hnext;
+            release(entry);
+        }
+    }
+}
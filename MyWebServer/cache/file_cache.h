@@ -0,0 +1,82 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include "../lock/locker.h"
+
+// 缓存的静态文件 (引用计数: 缓存本身持有一个引用，每个正在发送它的响应各持有一个。被替换或淘汰后，最后一个引用释放时才关闭文件)
+struct file_entry
+{
+    std::string path;                 // 完整路径 (缓存的键)
+    unsigned hash;
+    struct stat st;                   // 文件信息
+    int fd;                           // 文件描述符 (用sendfile发送的文件保持打开，否则为-1)
+    char *addr;                       // 映射到内存的文件内容 (较小的文件，否则为NULL)
+    const char *type;                 // Content-Type (按扩展名确定)
+    char etag[48];                    // 实体标签 (由inode、大小和纳秒级修改时间生成的强校验值，不含引号)
+    int etag_len;
+    char validators[128];             // 除ETag外的缓存控制字段 (Last-Modified和按路径前缀配置的Cache-Control)
+    int validators_len;
+    char header[320];                 // 预先生成的响应头 (状态行、Content-Length、Content-Type、Accept-Ranges、Vary、ETag和validators，不含Date和Connection)
+    int header_len;
+    long long expire;                 // 到期时间 (毫秒，到期后重新stat，用于inotify监视不到的情况)
+    std::atomic<int> ref;
+
+    file_entry *hnext;                // 同一哈希桶中的下一项
+    file_entry *prev;                 // LRU链表 (表头为最近使用的)
+    file_entry *next;
+};
+
+// 分片的文件描述符/stat缓存 (按路径哈希分成多个分片，每个分片一把锁、一张哈希表和一个LRU链表，总项数有上限。
+// 网站根目录下的文件变化由inotify监视线程及时失效，子目录中的文件由TTL兜底。含有..路径段的请求在http_conn中已被拒绝，不会进入缓存)
+class file_cache
+{
+public:
+    static const int SHARD_NUM = 16;
+    static const int BUCKET_NUM = 64;                    // 每个分片的哈希桶数
+    static const int MAX_ENTRIES = 1024;                 // 总项数上限 (每个分片MAX_ENTRIES / SHARD_NUM项)
+    static const int TTL_MS = 5000;                      // 缓存项的有效期
+
+    // 局部静态变量 (单例模式)
+    static file_cache *get_instance();
+
+    bool init(const char *root);                         // 启动监视网站根目录的线程 (失败时只依靠TTL)
+    bool set_max_age(const char *rules);                 // 按URL路径前缀配置Cache-Control的max-age (格式为"前缀=秒数,前缀=秒数"，最长前缀优先。格式有误时返回false)
+
+    file_entry *lookup(const char *path);                // 查找未过期的缓存项 (增加引用计数)，未命中返回NULL
+    file_entry *load(const char *path, const struct stat &st, int map_threshold);    // 打开文件并加入缓存 (增加引用计数)，失败返回NULL。小于map_threshold的文件映射到内存，其余保持打开用于sendfile (小于0表示全部映射)
+    static void release(file_entry *entry);              // 释放一个引用
+
+    static unsigned hash_path(const char *path);         // 路径的哈希值 (FNV-1a)
+    static const char *content_type(const char *path, int len);    // 按扩展名确定的Content-Type (未知类型为application/octet-stream)
+    static long long now_ms();                           // 单调时钟的当前毫秒数 (CLOCK_MONOTONIC_COARSE经vDSO读取，不进入内核)
+
+private:
+    file_cache();
+
+    struct shard
+    {
+        locker lock;
+        file_entry *buckets[BUCKET_NUM];
+        file_entry head;                 // LRU链表的哨兵
+        int count;
+    };
+
+    static void *watch_worker(void *arg);
+    void watch();                          // inotify监视线程
+    void invalidate(const char *path);     // 删除路径对应的缓存项
+    void invalidate_all();
+    void unlink(shard &s, file_entry *entry);    // 从分片中摘除 (调用者持有分片的锁，并负责释放缓存持有的引用)
+    int max_age(const char *path);         // 完整路径对应的max-age (没有匹配的前缀时返回-1)
+
+    shard m_shards[SHARD_NUM];
+    std::string m_root;                    // 网站根目录
+    int m_inotify_fd;
+    std::vector<std::pair<std::string, int> > m_max_age;    // max-age规则 (按前缀长度降序排列，启动时设置，之后只读)
+};
+
+#endif
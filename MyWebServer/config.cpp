@@ -30,11 +30,41 @@ Config::Config(){
 
     // 并发模型,默认是proactor
     actor_model = 0;
+
+    // 子反应堆数量,默认0 (即CPU核数，仅multi-reactor模式下有效)
+    reactor_num = 0;
+
+    // I/O后端,默认epoll (1为io_uring，内核不支持时自动回退到epoll)
+    io_backend = 0;
+
+    // 请求头超时,默认10秒 (从连接建立或开始接收新请求时计时)
+    header_timeout = 10;
+
+    // 请求体基础超时,默认10秒 (另按Content-Length每8KB增加1秒)
+    body_timeout = 10;
+
+    // 长连接空闲超时,默认5秒
+    idle_timeout = 5;
+
+    // 发送停滞超时,默认10秒 (每次有数据发出时重新计时)
+    write_timeout = 10;
+
+    // 每个长连接最多处理的请求数,默认100 (0表示不限制)
+    max_requests = 100;
+
+    // sendfile阈值,默认16KB (更小的文件使用mmap + writev，-1表示全部使用mmap)
+    sendfile_threshold = 16384;
+
+    // 静态文件内存缓存,默认64MB (0表示不缓存)
+    cache_size = 64;
+
+    // Cache-Control max-age规则,默认为空 (不发送Cache-Control，浏览器每次用条件请求验证)
+    max_age = "";
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:i:h:b:k:w:n:f:e:x:";
     while ((opt = getopt(argc, argv, str)) != -1)    // getopt():  解析命令行选项参数
     {
         switch (opt)
@@ -79,6 +109,56 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'r':
+        {
+            reactor_num = atoi(optarg);
+            break;
+        }
+        case 'i':
+        {
+            io_backend = atoi(optarg);
+            break;
+        }
+        case 'h':
+        {
+            header_timeout = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            body_timeout = atoi(optarg);
+            break;
+        }
+        case 'k':
+        {
+            idle_timeout = atoi(optarg);
+            break;
+        }
+        case 'w':
+        {
+            write_timeout = atoi(optarg);
+            break;
+        }
+        case 'n':
+        {
+            max_requests = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            sendfile_threshold = atoi(optarg);
+            break;
+        }
+        case 'e':
+        {
+            cache_size = atoi(optarg);
+            break;
+        }
+        case 'x':
+        {
+            max_age = optarg;
+            break;
+        }
         default:
             break;
         }
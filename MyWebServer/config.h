@@ -42,6 +42,36 @@ public:
 
     // 并发模型选择
     int actor_model;
+
+    // multi-reactor模式下的子反应堆数量
+    int reactor_num;
+
+    // I/O后端选择
+    int io_backend;
+
+    // 接收请求头的超时时间 (秒)
+    int header_timeout;
+
+    // 接收请求体的基础超时时间 (秒)
+    int body_timeout;
+
+    // 长连接空闲超时时间 (秒)
+    int idle_timeout;
+
+    // 发送响应停滞的超时时间 (秒)
+    int write_timeout;
+
+    // 每个长连接最多处理的请求数
+    int max_requests;
+
+    // 用sendfile发送的最小文件大小 (字节)
+    int sendfile_threshold;
+
+    // 静态文件内存缓存的容量 (MB)
+    int cache_size;
+
+    // 按路径前缀配置的Cache-Control max-age (秒)
+    string max_age;
 };
 
 #endif
\ No newline at end of file
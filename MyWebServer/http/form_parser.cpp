@@ -0,0 +1,353 @@
+#include "form_parser.h"
+
+#include <string.h>
+#include <strings.h>
+
+// JSON解析的状态
+enum JSON_STATE
+{
+    J_BEGIN = 0,    // 等待'{'
+    J_FIRST,        // '{'之后: 等待第一个键或'}'
+    J_MEMBER,       // ','之后: 等待下一个键
+    J_KEY,          // 键的字符串中
+    J_COLON,        // 等待':'
+    J_VALUE,        // 等待值
+    J_STRING,       // 字符串值中
+    J_LITERAL,      // 数字、true、false或null中
+    J_NEXT,         // 值之后: 等待','或'}'
+    J_END           // '}'之后: 只允许空白
+};
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static bool is_space(char c)
+{
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+// JSON中不带引号的值是否合法 (true、false、null或数字)
+static bool valid_literal(const char *s, int len)
+{
+    if ((4 == len && memcmp(s, "true", 4) == 0) || (5 == len && memcmp(s, "false", 5) == 0) || (4 == len && memcmp(s, "null", 4) == 0))
+        return true;
+    if (0 == len || ('-' != s[0] && (s[0] < '0' || s[0] > '9')))
+        return false;
+    for (int i = 1; i < len; ++i)
+    {
+        if ((s[i] < '0' || s[i] > '9') && !strchr("+-.eE", s[i]))
+            return false;
+    }
+    return true;
+}
+
+int form_parser::type_of(const char *content_type, int len)
+{
+    static const char json[] = "application/json";
+    const int n = sizeof(json) - 1;
+    if (content_type && len >= n && strncasecmp(content_type, json, n) == 0 && (len == n || ';' == content_type[n] || ' ' == content_type[n]))
+        return JSON;
+    return URLENCODED;
+}
+
+void form_parser::init(int type)
+{
+    m_type = type;
+    m_state = J_BEGIN;
+    m_in_value = false;
+    m_pending = false;
+    m_escape = 0;
+    m_code = 0;
+    m_high = 0;
+    m_key_len = 0;
+    m_value_len = 0;
+}
+
+int form_parser::next(const char **p, const char *end, bool last, form_field *field)
+{
+    if (JSON == m_type)
+        return next_json(p, end, last, field);
+    return next_urlencoded(p, end, last, field);
+}
+
+bool form_parser::append(char c)
+{
+    if (m_in_value)
+    {
+        if (m_value_len == MAX_VALUE)
+            return false;
+        m_value[m_value_len++] = c;
+        return true;
+    }
+    if (m_key_len == MAX_KEY)
+        return false;
+    m_key[m_key_len++] = c;
+    return true;
+}
+
+bool form_parser::append_utf8(unsigned code)
+{
+    if (code < 0x80)
+        return append(code);
+    if (code < 0x800)
+        return append(0xc0 | (code >> 6)) && append(0x80 | (code & 0x3f));
+    if (code < 0x10000)
+        return append(0xe0 | (code >> 12)) && append(0x80 | ((code >> 6) & 0x3f)) && append(0x80 | (code & 0x3f));
+    return append(0xf0 | (code >> 18)) && append(0x80 | ((code >> 12) & 0x3f)) && append(0x80 | ((code >> 6) & 0x3f)) && append(0x80 | (code & 0x3f));
+}
+
+// 交出当前字段 (视图指向m_key和m_value，下一个字段开始写入前有效)
+int form_parser::emit(form_field *field)
+{
+    field->key = m_key;
+    field->key_len = m_key_len;
+    field->value = m_value;
+    field->value_len = m_value_len;
+    m_key_len = 0;
+    m_value_len = 0;
+    m_in_value = false;
+    m_pending = false;
+    return FORM_FIELD;
+}
+
+// 字段之间以'&'分隔，键和值之间以'='分隔 (没有'='时值为空)；'+'解码为空格，%XX解码为对应的字节，解码出的'&'和'='不再作为分隔符
+int form_parser::next_urlencoded(const char **p, const char *end, bool last, form_field *field)
+{
+    while (*p < end)
+    {
+        char c = *(*p)++;
+        if (m_escape)
+        {
+            int h = hex_value(c);
+            if (h < 0)
+                return FORM_ERROR;
+            m_code = m_code * 16 + h;
+            if (++m_escape < 3)
+                continue;
+            m_escape = 0;
+            if (!append(m_code))
+                return FORM_ERROR;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '&':
+            if (m_pending)
+                return emit(field);
+            break;
+        case '=':
+            m_pending = true;
+            if (!m_in_value)
+                m_in_value = true;
+            else if (!append(c))
+                return FORM_ERROR;
+            break;
+        case '%':
+            m_pending = true;
+            m_escape = 1;
+            m_code = 0;
+            break;
+        case '+':
+            c = ' ';
+            // fall through
+        default:
+            m_pending = true;
+            if (!append(c))
+                return FORM_ERROR;
+        }
+    }
+
+    if (!last)
+        return FORM_MORE;
+    if (m_escape)
+        return FORM_ERROR;
+    if (m_pending)
+        return emit(field);
+    return FORM_DONE;
+}
+
+// JSON字符串中的一个字符 (处理\X和\uXXXX转义，代理对合并为一个码点后按UTF-8写入)
+int form_parser::json_string(char c)
+{
+    if (0 == m_escape)
+    {
+        if ('"' == c)
+            return m_high ? -1 : 1;
+        if ('\\' == c)
+        {
+            m_escape = 1;
+            return 0;
+        }
+        if ((unsigned char)c < 0x20 || m_high)
+            return -1;
+        return append(c) ? 0 : -1;
+    }
+
+    if (1 == m_escape)
+    {
+        char out;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            out = c;
+            break;
+        case 'b':
+            out = '\b';
+            break;
+        case 'f':
+            out = '\f';
+            break;
+        case 'n':
+            out = '\n';
+            break;
+        case 'r':
+            out = '\r';
+            break;
+        case 't':
+            out = '\t';
+            break;
+        case 'u':
+            m_escape = 2;
+            m_code = 0;
+            return 0;
+        default:
+            return -1;
+        }
+        m_escape = 0;
+        if (m_high)
+            return -1;
+        return append(out) ? 0 : -1;
+    }
+
+    int h = hex_value(c);
+    if (h < 0)
+        return -1;
+    m_code = m_code * 16 + h;
+    if (++m_escape < 6)
+        return 0;
+    m_escape = 0;
+
+    if (m_high)
+    {
+        if (m_code < 0xdc00 || m_code > 0xdfff)
+            return -1;
+        unsigned code = 0x10000 + ((m_high - 0xd800) << 10) + (m_code - 0xdc00);
+        m_high = 0;
+        return append_utf8(code) ? 0 : -1;
+    }
+    if (m_code >= 0xd800 && m_code <= 0xdbff)
+    {
+        m_high = m_code;
+        return 0;
+    }
+    if (m_code >= 0xdc00 && m_code <= 0xdfff)
+        return -1;
+    return append_utf8(m_code) ? 0 : -1;
+}
+
+int form_parser::next_json(const char **p, const char *end, bool last, form_field *field)
+{
+    while (*p < end)
+    {
+        char c = **p;
+        if (is_space(c) && J_KEY != m_state && J_STRING != m_state && J_LITERAL != m_state)
+        {
+            ++*p;
+            continue;
+        }
+
+        switch (m_state)
+        {
+        case J_BEGIN:
+            if ('{' != c)
+                return FORM_ERROR;
+            m_state = J_FIRST;
+            break;
+        case J_FIRST:
+        case J_MEMBER:
+            if ('}' == c && J_FIRST == m_state)
+                m_state = J_END;
+            else if ('"' == c)
+            {
+                m_in_value = false;
+                m_state = J_KEY;
+            }
+            else
+                return FORM_ERROR;
+            break;
+        case J_KEY:
+        case J_STRING:
+        {
+            int ret = json_string(c);
+            if (ret < 0)
+                return FORM_ERROR;
+            if (ret > 0)
+            {
+                ++*p;
+                if (J_KEY == m_state)
+                {
+                    m_state = J_COLON;
+                    continue;
+                }
+                m_state = J_NEXT;
+                return emit(field);
+            }
+            break;
+        }
+        case J_COLON:
+            if (':' != c)
+                return FORM_ERROR;
+            m_in_value = true;
+            m_state = J_VALUE;
+            break;
+        case J_VALUE:
+            if ('"' == c)
+                m_state = J_STRING;
+            else if ('-' == c || (c >= '0' && c <= '9') || 't' == c || 'f' == c || 'n' == c)
+            {
+                m_state = J_LITERAL;
+                continue;    // 第一个字符由J_LITERAL写入
+            }
+            else
+                return FORM_ERROR;    // 不支持嵌套的对象和数组
+            break;
+        case J_LITERAL:
+            if (is_space(c) || ',' == c || '}' == c)
+            {
+                // 结束字符留给J_NEXT处理
+                if (!valid_literal(m_value, m_value_len))
+                    return FORM_ERROR;
+                m_state = J_NEXT;
+                return emit(field);
+            }
+            if (!append(c))
+                return FORM_ERROR;
+            break;
+        case J_NEXT:
+            if (',' == c)
+                m_state = J_MEMBER;
+            else if ('}' == c)
+                m_state = J_END;
+            else
+                return FORM_ERROR;
+            break;
+        default:
+            return FORM_ERROR;    // '}'之后还有数据
+        }
+        ++*p;
+    }
+
+    if (!last)
+        return FORM_MORE;
+    return J_END == m_state ? FORM_DONE : FORM_ERROR;
+}
@@ -0,0 +1,62 @@
+#ifndef FORM_PARSER_H
+#define FORM_PARSER_H
+
+// 解析出的一个表单字段 (键和值已解码，指向解析器内部的缓冲区，在下一次调用next前有效；值不以'\0'结尾)
+struct form_field
+{
+    const char *key;
+    int key_len;
+    const char *value;
+    int value_len;
+};
+
+// 请求体表单解析器 (application/x-www-form-urlencoded或只有一层的JSON对象)
+// 增量解析: 请求体可以分多次传入，跨越两次传入的键和值解码到固定大小的内部缓冲区中，整个过程不分配内存
+class form_parser
+{
+public:
+    static const int MAX_KEY = 64;       // 键解码后的最大长度
+    static const int MAX_VALUE = 1024;   // 值解码后的最大长度 (超出时解析失败)
+
+    enum TYPE
+    {
+        URLENCODED = 0,    // user=a&password=b (%XX和+解码)
+        JSON               // {"user":"a","password":"b"} (值为字符串、数字、true、false或null，不支持嵌套)
+    };
+    enum STATUS
+    {
+        FORM_MORE = 0,     // 传入的数据已解析完，需要更多数据
+        FORM_FIELD,        // 解析出一个字段
+        FORM_DONE,         // 请求体结束
+        FORM_ERROR         // 格式有误或键、值过长
+    };
+
+    static int type_of(const char *content_type, int len);    // 按Content-Type选择格式 (application/json为JSON，其余按urlencoded解析)
+
+    void init(int type);
+    // 从*p开始解析[*p, end)中的数据，*p前移到已解析的位置。last表示这是请求体的最后一段
+    // 每解析出一个字段返回一次FORM_FIELD (剩余数据由下一次调用继续解析)，数据用完时返回FORM_MORE (last时返回FORM_DONE)
+    int next(const char **p, const char *end, bool last, form_field *field);
+
+private:
+    int next_urlencoded(const char **p, const char *end, bool last, form_field *field);
+    int next_json(const char **p, const char *end, bool last, form_field *field);
+    int json_string(char c);    // JSON字符串中的一个字符 (0: 继续, 1: 字符串结束, -1: 出错)
+    bool append(char c);        // 向当前的键或值追加一个字节 (超出长度上限时返回false)
+    bool append_utf8(unsigned code);
+    int emit(form_field *field);
+
+    int m_type;
+    int m_state;
+    bool m_in_value;            // 当前在解析值 (否则为键)
+    bool m_pending;             // urlencoded: 当前字段已有数据 (空字段如"a&&b"中的不产生结果)
+    int m_escape;               // 转义序列中已读取的字符数 (urlencoded的%XX、JSON的\X和\uXXXX)
+    unsigned m_code;            // 转义序列已解码的部分
+    unsigned m_high;            // JSON: \uXXXX代理对的高半部分 (没有时为0)
+    char m_key[MAX_KEY];
+    int m_key_len;
+    char m_value[MAX_VALUE];
+    int m_value_len;
+};
+
+#endif
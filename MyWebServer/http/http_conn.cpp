@@ -1,18 +1,53 @@
 #include "http_conn.h"
+#include "http_scan.h"
+#include "http_date.h"
+#include "form_parser.h"
 
 #include <mysql/mysql.h>
+#include <dirent.h>
+#include <limits.h>
+#include <strings.h>
 #include <fstream>
 
 // 定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *ok_206_title = "Partial Content";
+const char *ok_304_title = "Not Modified";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
 const char *error_403_form = "You do not have permission to get file form this server.\n";
 const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
+const char *error_413_title = "Payload Too Large";
+const char *error_413_form = "The request body exceeds the upload limit of this resource.\n";
+const char *error_416_title = "Range Not Satisfiable";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
+const char *byteranges_boundary = "3d6b6a416f9b5a7c";    // 多区间响应各部分之间的分隔符
+const char *empty_file_form = "<html><body></body></html>";
+
+// 内容固定的响应 (状态行、Content-Length和Content-Type在启动时生成，之后只读。发送时响应头复制到写缓冲区，内容由iovec直接指向)
+struct canned_response
+{
+    std::string head;
+    const char *body;
+    int body_len;
+
+    canned_response(int status, const char *title, const char *type, const char *form) : body(form), body_len(strlen(form))
+    {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\nContent-Length:%d\r\nContent-Type:%s\r\n", status, title, body_len, type);
+        head = buf;
+    }
+};
+
+static const canned_response response_empty(200, ok_200_title, "text/html; charset=utf-8", empty_file_form);
+static const canned_response response_400(400, error_400_title, "text/plain; charset=utf-8", error_400_form);
+static const canned_response response_403(403, error_403_title, "text/plain; charset=utf-8", error_403_form);
+static const canned_response response_404(404, error_404_title, "text/plain; charset=utf-8", error_404_form);
+static const canned_response response_413(413, error_413_title, "text/plain; charset=utf-8", error_413_form);
+static const canned_response response_500(500, error_500_title, "text/plain; charset=utf-8", error_500_form);
 
 locker m_lock;
 map<string, string> users;    // 数据库读取表 (存储用户名和密码)
@@ -71,7 +106,8 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     if (one_shot)
         event.events |= EPOLLONESHOT;   // 一个socket连接在任一时刻都只被一个线程处理 (对于注册了EPOLLONESHOT事件的文件描述符，操作系统最多触发其上注册的一个可读、可写或者异常事件，且只触发一次)
 
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    if (epollfd >= 0)    // io_uring后端下连接不注册到epoll (epollfd为-1)
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
     setnonblocking(fd);
 }
 
@@ -85,6 +121,9 @@ void removefd(int epollfd, int fd)
 // 内核事件表注册新事件，开启EPOLLONESHOT (注册了EPOLLONESHOT事件的socket一旦被某个线程处理完毕，该线程应该立即重置这个socket上的EPOLLONESHOT事件，以确保这个socket下一次可读时，其EPOLLIN事件能被触发，进而让其他线程有机会继续处理这个socket)
 void modfd(int epollfd, int fd, int ev, int TRIGMode)
 {
+    if (epollfd < 0)     // io_uring后端下由调用者提交下一步操作
+        return;
+
     epoll_event event;
     event.data.fd = fd;
 
@@ -96,8 +135,34 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+std::atomic<int> http_conn::m_user_count(0);
+int http_conn::m_max_requests = 0;
+int http_conn::m_sendfile_threshold = -1;
+const char *http_conn::m_upload_dir = "/tmp";
+
+// 从缓冲区池借用一块存放T (请求头表、发送状态等只在处理请求期间需要的状态，空闲的长连接不占用)
+template <typename T>
+static T *borrow()
+{
+    int cap;
+    char *mem = buffer_pool::get_instance()->alloc(sizeof(T), &cap);
+    return mem ? new (mem) T : NULL;
+}
+
+// 归还borrow借用的块 (p为NULL时不做任何事)
+template <typename T>
+static void give_back(T *&p)
+{
+    buffer_pool::get_instance()->release((char *)p, sizeof(T));
+    p = NULL;
+}
+
+http_conn::~http_conn()
+{
+    release_read();
+    give_back(m_send);
+    give_back(m_upload_state);
+}
 
 // 关闭连接 (关闭一个连接，客户总量减一)
 void http_conn::close_conn(bool real_close)
@@ -112,24 +177,27 @@ void http_conn::close_conn(bool real_close)
 }
 
 // 初始化新连接 (外部调用初始化套接字地址)
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
+void http_conn::init(int epollfd, int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
                      int close_log, string user, string passwd, string sqlname)
 {
+    m_epollfd = epollfd;
     m_sockfd = sockfd;
     m_address = addr;
+    m_TRIGMode = TRIGMode;
 
     addfd(m_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++;
+    m_generation++;
 
     // 当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
     strcpy(sql_user, user.c_str());
     strcpy(sql_passwd, passwd.c_str());
     strcpy(sql_name, sqlname.c_str());
 
+    m_request_count = 0;
     init();
 }
 
@@ -137,29 +205,105 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 void http_conn::init()
 {
     mysql = NULL;
-    bytes_to_send = 0;
-    bytes_have_send = 0;
+    m_state = 0;
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_checked_idx = 0;
+    m_read_idx = 0;
+
+    release_read();     // 上一个连接因超时等原因关闭时可能还借用着缓冲区和文件映射，在此一并归还
+    init_request();
+    init_response();
+}
+
+// 开始解析下一个请求 (长连接上一个请求解析完毕后调用。读缓冲区中可能已有后续流水线请求的数据，不能清空)
+void http_conn::init_request()
+{
+    // 恢复被请求体结尾'\0'改写的字节
+    if (CHECK_STATE_CONTENT == m_check_state)
+        m_read_buf[m_checked_idx] = m_body_next;
+
+    // 将尚未解析的数据移到读缓冲区开头，腾出空间继续接收；没有剩余数据时归还读缓冲区 (空闲的长连接不占用缓冲区)
+    m_read_idx -= m_checked_idx;
+    if (m_read_idx > 0)
+    {
+        memmove(m_read_buf, m_read_buf + m_checked_idx, m_read_idx);
+        m_read_buf[m_read_idx] = '\0';
+    }
+    else
+        release_read();
+    m_checked_idx = 0;
+    m_start_line = 0;
+
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
     m_method = GET;
     m_url = 0;
     m_version = 0;
+    m_http11 = false;
     m_content_length = 0;
-    m_host = 0;
-    m_start_line = 0;
-    m_checked_idx = 0;
-    m_read_idx = 0;
-    m_write_idx = 0;
-    cgi = 0;
-    m_state = 0;
-    timer_flag = 0;
-    improv = 0;
-
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
+    m_chunked = false;
+    m_upload = NULL;
+    close_part();       // 上传中途出错或连接被关闭时删除未完成的临时文件
+    give_back(m_upload_state);
+    if (m_headers)
+        m_headers->clear();
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+// 响应全部发送完毕后重置发送状态
+void http_conn::init_response()
+{
+    release_files();
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_write_buf.clear();
+    give_back(m_send);
+    m_iv_count = 0;
+    m_response_count = 0;
+    m_keep_alive = false;
+    m_stream = NULL;
+}
+
+// 保证读缓冲区还有剩余空间 (未借用时借用最小一级；已满说明请求报文还不完整，换成大一级的缓冲区，超过READ_BUFFER_SIZE时失败)
+bool http_conn::reserve_read()
+{
+    if (m_read_buf && m_read_idx < m_read_size)
+        return true;
+
+    int size = m_read_buf ? (m_read_size + 1) * 2 : buffer_pool::MIN_SIZE;
+    if (size > READ_BUFFER_SIZE)
+        return false;
+
+    int cap;
+    if (!m_headers && !(m_headers = borrow<header_table>()))
+        return false;
+    char *buf = buffer_pool::get_instance()->alloc(size, &cap);
+    if (!buf)
+        return false;
+    if (m_read_buf)
+    {
+        memcpy(buf, m_read_buf, m_read_idx);
+        // 已解析出的字段指向旧缓冲区，随之平移
+        if (m_url)
+            m_url = buf + (m_url - m_read_buf);
+        if (m_version)
+            m_version = buf + (m_version - m_read_buf);
+        buffer_pool::get_instance()->release(m_read_buf, m_read_size + 1);
+    }
+    m_read_buf = buf;
+    m_read_size = cap - 1;
+    return true;
+}
+
+// 归还读缓冲区 (请求头表只记录读缓冲区中的偏移，一并归还)
+void http_conn::release_read()
+{
+    buffer_pool::get_instance()->release(m_read_buf, m_read_size + 1);
+    m_read_buf = NULL;
+    m_read_size = 0;
+    give_back(m_headers);
+}
+
 
 // 从状态机: 用于分析出一行内容 (返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN)
 http_conn::LINE_STATUS http_conn::parse_line()
@@ -167,6 +311,10 @@ http_conn::LINE_STATUS http_conn::parse_line()
     char temp;
     for (; m_checked_idx < m_read_idx; ++m_checked_idx)
     {
+        // 跳过普通字符，直接定位到下一个'\r'或'\n' (一次比较16/32个字节)
+        m_checked_idx = http_scan::find_eol(m_read_buf + m_checked_idx, m_read_buf + m_read_idx) - m_read_buf;
+        if (m_checked_idx == m_read_idx)
+            break;
         temp = m_read_buf[m_checked_idx];     // temp为将要分析的字符
 
         // 如果当前字节是'\r'字符，则有可能会读取到完整行
@@ -201,7 +349,7 @@ http_conn::LINE_STATUS http_conn::parse_line()
 // 循环读取客户数据，直到无数据可读或对方关闭连接 (非阻塞ET工作模式下，需要一次性将数据读完)
 bool http_conn::read_once()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)     // 正常情况下，0 <= m_read_idx < READ_BUFFER_SIZE
+    if (!reserve_read())     // 请求报文超过READ_BUFFER_SIZE仍不完整
     {
         return false;
     }
@@ -210,13 +358,14 @@ bool http_conn::read_once()
     // LT读取数据
     if (0 == m_TRIGMode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
 
         if (bytes_read <= 0)     
         {
             return false;
         }
+        m_read_idx += bytes_read;
+        m_read_buf[m_read_idx] = '\0';    // 借用的缓冲区不再清零，已接收的数据总以'\0'结尾 (日志按字符串打印请求体时不会越界)
 
         return true;
     }
@@ -225,7 +374,7 @@ bool http_conn::read_once()
     {
         while (true)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);  // 循环读取
+            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);  // 循环读取
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)    // EAGIN、EWOULDBLOCK 表示当前没有数据可读，不需要重新读 (读完了)
@@ -237,6 +386,9 @@ bool http_conn::read_once()
                 return false;
             }
             m_read_idx += bytes_read;  // 循环累加
+            m_read_buf[m_read_idx] = '\0';
+            if (m_read_idx >= m_read_size)    // 读缓冲区已满，先处理已接收的请求 (请求仍不完整时下次读取前再扩大缓冲区，重新注册事件时剩余数据会再次触发可读事件)
+                break;
         }
         return true;
     }
@@ -261,7 +413,6 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     else if (strcasecmp(method, "POST") == 0)
     {
         m_method = POST;
-        cgi = 1;    // 启用POST
     }
     else
         return BAD_REQUEST;
@@ -276,7 +427,11 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     }
     *m_version++ = '\0';
     m_version += strspn(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)    // 仅支持HTTP/1.1
+    // 支持HTTP/1.1和HTTP/1.0。HTTP/1.1默认为长连接，HTTP/1.0需通过Connection: keep-alive显式开启
+    m_http11 = strcasecmp(m_version, "HTTP/1.1") == 0;
+    if (m_http11)
+        m_linger = true;
+    else if (strcasecmp(m_version, "HTTP/1.0") != 0)
         return BAD_REQUEST;
 
     if (strncasecmp(m_url, "http://", 7) == 0)     // 对请求资源前7个字符进行判断 (因为有些报文的请求资源中会带有http://，这里需要对这种情况进行单独处理)
@@ -311,41 +466,93 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
     if (text[0] == '\0')
     {
         // 判断是GET还是POST请求
-        if (m_content_length != 0)    
+        if (!m_chunked && 0 == m_content_length)
+            return GET_REQUEST;                    // GET请求，则解析结束 (接收到一个完整的请求)
+        // chunked请求体长度未知，边接收边解码 (同时带有Content-Length时无法确定请求体的边界，按错误请求处理)
+        if (m_chunked && m_headers->find(HDR_CONTENT_LENGTH))
+            return BAD_REQUEST;
+
+        // 交给接受上传的路由的multipart/form-data请求体边接收边写入临时文件，只受路由的上传上限限制；其余请求体需要完整放入读缓冲区
+        header_view type = get_header(HDR_CONTENT_TYPE);
+        route_handler *handler = NULL;
+        multipart_parser multipart;
+        if (type.str && multipart.init(type.str, type.len))
+            handler = router::get_instance()->find(m_method, m_url, strlen(m_url));
+        if (handler && handler->upload_limit() > 0)
         {
-            m_check_state = CHECK_STATE_CONTENT;   // POST请求，则需要跳转到消息体处理状态
-            return NO_REQUEST;
+            if (m_content_length > handler->upload_limit())
+                return REQUEST_TOO_LARGE;
+            if (!(m_upload_state = borrow<upload_state>()))
+                return INTERNAL_ERROR;
+            m_upload_state->multipart = multipart;
+            m_upload = handler;
+            m_upload_limit = handler->upload_limit() < INT_MAX ? handler->upload_limit() : INT_MAX;
+            m_body_left = m_content_length;
+            m_body_total = 0;
         }
-        return GET_REQUEST;                        // GET请求，则解析结束 (接收到一个完整的请求)    
+        else if (!m_chunked && (m_content_length < 0 || m_checked_idx + m_content_length >= READ_BUFFER_SIZE))
+            return BAD_REQUEST;                    // 请求体超出读缓冲区的最大容量，无法接收完整
+
+        m_check_state = CHECK_STATE_CONTENT;       // POST请求，则需要跳转到消息体处理状态
+        m_chunk_state = CHUNK_SIZE_START;
+        m_chunk_left = 0;
+        m_body_start = m_checked_idx;
+        m_body_len = 0;
+        return NO_REQUEST;
     }
-    // 解析请求头的连接字段
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    // 字段名为行首到':'之间的部分，字段值为':'之后去掉首尾空白的部分 (当前行的结尾已由从状态机改写为"\0\0"，m_checked_idx指向下一行开头)
+    const char *end = m_read_buf + m_checked_idx - 2;
+    const char *colon = http_scan::find_char(text, end, ':');
+    if (colon == end || colon == text)
+        return BAD_REQUEST;                        // 没有字段名或缺少':'
+    int name_len = colon - text;
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
+        ++value;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    int value_len = end - value;
+
+    // 只记录字段在读缓冲区中的位置，不复制字段值 (已知字段经完美哈希得到HEADER_ID)
+    int id = header_table::lookup(text, name_len);
+    if (!m_headers->add(id, text - m_read_buf, name_len, value - m_read_buf, value_len))
+        return BAD_REQUEST;                        // 字段数超出上限
+
+    // 影响报文解析的字段在这里处理，其余字段由之后的处理按需通过get_header读取
+    if (HDR_CONNECTION == id)
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
+        if (5 == value_len && http_scan::iequals(value, "close", 5))
+            m_linger = false;
+        else if (10 == value_len && http_scan::iequals(value, "keep-alive", 10))
             m_linger = true;    // 如果是长连接，则将linger标志设置为true
-        }
-    }
-    // 解析请求头的内容长度字段
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);    // atol(): 用于将给定的字符串值转换为整数值。它接受包含"整数"的字符串，并返回其长整数值。 
     }
-    // 解析请求头的HOST字段
-    else if (strncasecmp(text, "Host:", 5) == 0)   
+    else if (HDR_CONTENT_LENGTH == id)
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        // 只接受十进制数字 (超过读缓冲区容量的长度在空行处按错误请求处理或交给上传处理器判断，这里只需防止溢出)
+        if (0 == value_len)
+            return BAD_REQUEST;
+        long long length = 0;
+        for (int i = 0; i < value_len; ++i)
+        {
+            if (value[i] < '0' || value[i] > '9')
+                return BAD_REQUEST;
+            if (length <= INT_MAX)
+                length = length * 10 + (value[i] - '0');
+        }
+        if (length > INT_MAX)
+            return BAD_REQUEST;
+        // 多个Content-Length的值不同时无法确定请求体的边界 (前后的代理可能各取一个，造成请求走私)，按错误请求处理；值相同的重复字段可以接受
+        if (m_headers->find(HDR_CONTENT_LENGTH)->value != value - m_read_buf && length != m_content_length)
+            return BAD_REQUEST;
+        m_content_length = length;
     }
-    // 其他字段直接跳过(该项目只检查以上几个字段)
-    else
+    else if (HDR_TRANSFER_ENCODING == id)
     {
-        LOG_INFO("oop!unknow header: %s", text);    // log打印未解析的字段
+        // 只支持chunked (其余编码无法解码，也就无法确定请求体的边界)
+        if (7 != value_len || !http_scan::iequals(value, "chunked", 7))
+            return BAD_REQUEST;
+        m_chunked = true;
     }
 
     return NO_REQUEST;    // 继续读取头部字段，直到遇到空行，则说明头部字段解析完毕
@@ -355,9 +562,16 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
 // 主状态机解析HTTP请求体
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
+    if (m_upload)
+        return parse_upload();
+    if (m_chunked)
+        return parse_chunked();
+
     // 判断buffer中是否读取了消息体
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
+        m_checked_idx += m_content_length;    // 请求体之后的数据属于下一个流水线请求
+        m_body_next = m_read_buf[m_checked_idx];
         text[m_content_length] = '\0';
         m_string = text;    // POST请求体中的数据为输入的用户名和密码
         return GET_REQUEST;
@@ -365,6 +579,244 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
     return NO_REQUEST;
 }
 
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// 解码chunked请求体: 各块的数据就地前移，依次拼接到m_body_start之后 (解码后的数据总是不长于已解析的原始数据，不会覆盖未解析的部分)。
+// 数据不完整时记下状态，下次接收后从m_checked_idx继续；解码后的请求体同样不能超过读缓冲区的最大容量
+http_conn::HTTP_CODE http_conn::parse_chunked()
+{
+    while (m_checked_idx < m_read_idx)
+    {
+        char c = m_read_buf[m_checked_idx];
+        switch (m_chunk_state)
+        {
+        case CHUNK_SIZE_START:
+        case CHUNK_SIZE:
+        {
+            int h = hex_digit(c);
+            if (h >= 0)
+            {
+                if (m_chunk_left > (m_upload ? m_upload_limit : READ_BUFFER_SIZE))
+                    return BAD_REQUEST;
+                m_chunk_left = m_chunk_left * 16 + h;
+                m_chunk_state = CHUNK_SIZE;
+            }
+            else if (CHUNK_SIZE_START == m_chunk_state)
+                return BAD_REQUEST;
+            else if (';' == c || ' ' == c || '\t' == c)
+                m_chunk_state = CHUNK_EXT;
+            else if ('\r' == c)
+                m_chunk_state = CHUNK_SIZE_LF;
+            else
+                return BAD_REQUEST;
+            break;
+        }
+        case CHUNK_EXT:
+            if ('\r' == c)
+                m_chunk_state = CHUNK_SIZE_LF;
+            break;
+        case CHUNK_SIZE_LF:
+            if ('\n' != c)
+                return BAD_REQUEST;
+            if (0 == m_chunk_left)
+                m_chunk_state = CHUNK_TRAILER;
+            else if (!m_upload && m_body_start + m_body_len + m_chunk_left >= READ_BUFFER_SIZE)
+                return BAD_REQUEST;
+            else
+                m_chunk_state = CHUNK_DATA;
+            break;
+        case CHUNK_DATA:
+        {
+            int n = m_read_idx - m_checked_idx;
+            if (n > m_chunk_left)
+                n = m_chunk_left;
+            memmove(m_read_buf + m_body_start + m_body_len, m_read_buf + m_checked_idx, n);
+            m_body_len += n;
+            m_checked_idx += n;
+            m_chunk_left -= n;
+            if (0 == m_chunk_left)
+                m_chunk_state = CHUNK_DATA_CR;
+            continue;
+        }
+        case CHUNK_DATA_CR:
+            if ('\r' != c)
+                return BAD_REQUEST;
+            m_chunk_state = CHUNK_DATA_LF;
+            break;
+        case CHUNK_DATA_LF:
+            if ('\n' != c)
+                return BAD_REQUEST;
+            m_chunk_state = CHUNK_SIZE_START;
+            break;
+        case CHUNK_TRAILER:
+            m_chunk_state = '\r' == c ? CHUNK_END_LF : CHUNK_TRAILER_LINE;
+            break;
+        case CHUNK_TRAILER_LINE:
+            if ('\n' == c)
+                m_chunk_state = CHUNK_TRAILER;
+            break;
+        case CHUNK_END_LF:
+            if ('\n' != c)
+                return BAD_REQUEST;
+            // 请求体结束 (之后的数据属于下一个流水线请求。结尾的'\0'写在已解析的原始数据中，不会改写下一个请求)
+            m_checked_idx++;
+            m_body_next = m_read_buf[m_checked_idx];
+            m_read_buf[m_body_start + m_body_len] = '\0';
+            m_string = m_read_buf + m_body_start;
+            m_content_length = m_body_len;
+            return GET_REQUEST;
+        }
+        ++m_checked_idx;
+    }
+
+    // 已解析的原始数据中除解码后的内容外都不再需要，把未解析的数据前移，腾出读缓冲区的空间继续接收
+    int gap = m_checked_idx - (m_body_start + m_body_len);
+    if (gap > 0)
+    {
+        memmove(m_read_buf + m_body_start + m_body_len, m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+        m_checked_idx -= gap;
+        m_read_idx -= gap;
+    }
+    return NO_REQUEST;
+}
+
+// 把一段数据全部写入文件 (普通文件的写入不会返回EAGAIN，被信号打断时重试)
+static bool write_all(int fd, const char *data, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+void http_conn::close_part()
+{
+    if (m_part_fd < 0)
+        return;
+    close(m_part_fd);
+    unlink(m_upload_state->part_path);
+    m_part_fd = -1;
+}
+
+// 流式接收multipart/form-data请求体: 读缓冲区中[m_body_start, m_body_start + m_body_len)为已接收 (chunked时已解码) 但尚未交给解析器的数据，
+// 解析出的各部分内容直接从读缓冲区写入临时文件，消耗掉的数据随即腾出，所以无论请求体多大，每个连接只占用一个读缓冲区
+http_conn::HTTP_CODE http_conn::parse_upload()
+{
+    bool last;
+    if (m_chunked)
+    {
+        HTTP_CODE ret = parse_chunked();
+        if (BAD_REQUEST == ret)
+        {
+            m_linger = false;    // 请求体的边界已无法确定
+            return BAD_REQUEST;
+        }
+        last = GET_REQUEST == ret;
+        if (m_body_total + m_body_len > m_upload_limit)
+        {
+            m_linger = false;
+            return REQUEST_TOO_LARGE;
+        }
+    }
+    else
+    {
+        // 读缓冲区中属于请求体的新数据直接接在未解析的数据之后 (m_checked_idx总是等于m_body_start + m_body_len)
+        int n = m_read_idx - m_checked_idx;
+        if (n > m_body_left)
+            n = m_body_left;
+        m_checked_idx += n;
+        m_body_len += n;
+        m_body_left -= n;
+        last = 0 == m_body_left;
+    }
+
+    const char *begin = m_read_buf + m_body_start;
+    const char *p = begin, *end = begin + m_body_len;
+    HTTP_CODE ret = NO_REQUEST;
+    const char *data;
+    int len;
+    int event;
+    while (NO_REQUEST == ret && (event = m_upload_state->multipart.next(&p, end, last, &data, &len)) != multipart_parser::MP_MORE)
+    {
+        switch (event)
+        {
+        case multipart_parser::MP_PART_BEGIN:
+            snprintf(m_upload_state->part_path, sizeof(m_upload_state->part_path), "%s/upload.XXXXXX", m_upload_dir);
+            m_part_fd = mkostemp(m_upload_state->part_path, O_CLOEXEC);
+            m_part_size = 0;
+            if (m_part_fd < 0)
+            {
+                LOG_ERROR("upload: mkostemp %s failed, errno is %d", m_upload_state->part_path, errno);
+                ret = INTERNAL_ERROR;
+            }
+            break;
+        case multipart_parser::MP_DATA:
+            if (!write_all(m_part_fd, data, len))
+            {
+                LOG_ERROR("upload: write %s failed, errno is %d", m_upload_state->part_path, errno);
+                ret = INTERNAL_ERROR;
+            }
+            m_part_size += len;
+            break;
+        case multipart_parser::MP_PART_END:
+        {
+            const multipart_parser &mp = m_upload_state->multipart;
+            upload_part part = {mp.name(), mp.filename(), mp.type(), m_upload_state->part_path, m_part_fd, m_part_size};
+            if (!m_upload->on_part(this, part))
+                ret = FORBIDDEN_REQUEST;    // 处理器拒绝了这个部分，终止上传
+            close_part();
+            break;
+        }
+        case multipart_parser::MP_DONE:
+            ret = GET_REQUEST;
+            break;
+        default:    // MP_ERROR
+            ret = BAD_REQUEST;
+        }
+    }
+    if (GET_REQUEST == ret)
+    {
+        // 请求体结束 (之后的数据属于下一个流水线请求)，处理器在handle中根据on_part收到的结果生成响应
+        m_body_next = m_read_buf[m_checked_idx];
+        m_string = m_read_buf + m_body_start;
+        m_content_length = 0;
+        return GET_REQUEST;
+    }
+    if (NO_REQUEST != ret)
+    {
+        m_linger = false;    // 请求体没有接收完，发送完错误响应即关闭连接
+        return ret;
+    }
+
+    // 已交给解析器的数据不再需要，把剩余数据 (可能是被截断的分隔符或部分头部) 和之后未解析的数据一起前移
+    int used = p - begin;
+    if (used > 0)
+    {
+        memmove(m_read_buf + m_body_start, m_read_buf + m_body_start + used, m_read_idx - m_body_start - used);
+        m_body_len -= used;
+        m_body_total += used;
+        m_checked_idx -= used;
+        m_read_idx -= used;
+    }
+    return NO_REQUEST;
+}
 
 // 主状态机: 从m_read_buf读缓冲区中读取数据，并处理请求报文
 http_conn::HTTP_CODE http_conn::process_read()
@@ -395,8 +847,8 @@ http_conn::HTTP_CODE http_conn::process_read()
         case CHECK_STATE_HEADER:
         {
             ret = parse_headers(text);        // 解析请求头
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            if (ret == BAD_REQUEST || ret == REQUEST_TOO_LARGE)
+                return ret;
             // 完整解析GET请求后，跳转到报文响应函数 (GET请求没有请求体)
             else if (ret == GET_REQUEST)
             {
@@ -410,8 +862,9 @@ http_conn::HTTP_CODE http_conn::process_read()
             // 完整解析POST请求后，跳转到报文响应函数
             if (ret == GET_REQUEST)
                 return do_request();
-            line_status = LINE_OPEN;
-            break;
+            if (ret != NO_REQUEST)
+                return ret;                   // 请求体有误或上传失败
+            return NO_REQUEST;                // 请求体不完整，继续接收 (不能再交给从状态机，否则m_checked_idx会越过请求体)
         }
         default:
             return INTERNAL_ERROR;
@@ -422,177 +875,538 @@ http_conn::HTTP_CODE http_conn::process_read()
 }
 
 
-// 生成响应报文
-http_conn::HTTP_CODE http_conn::do_request()
+// 从请求体中取出用户名和密码 (表单user=123&password=123或JSON {"user":"123","password":"123"}，按Content-Type区分)
+// 请求体逐字段解码，不分配内存；缺少字段、格式有误或超过name/password的长度时返回false
+static bool parse_user(http_conn *conn, char *name, char *password, int size)
 {
-    // 将初始化的m_real_file赋值为网站根目录
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-
-     // 找到请求文件地址m_url中最后一个'/'的位置
-    const char *p = strrchr(m_url, '/');    // strrchr(): 返回字符串m_url中最后一次出现字符'/'的位置。
+    header_view type = conn->get_header(HDR_CONTENT_TYPE);
+    form_parser parser;
+    parser.init(form_parser::type_of(type.str, type.len));
+
+    int len;
+    const char *p = conn->get_body(&len);
+    const char *end = p + len;
+    name[0] = password[0] = '\0';
+    form_field field;
+    int ret;
+    while ((ret = parser.next(&p, end, true, &field)) == form_parser::FORM_FIELD)
+    {
+        char *dst = NULL;
+        if (4 == field.key_len && memcmp(field.key, "user", 4) == 0)
+            dst = name;
+        else if (8 == field.key_len && memcmp(field.key, "password", 8) == 0)
+            dst = password;
+        if (!dst)
+            continue;
+        if (field.value_len >= size || memchr(field.value, '\0', field.value_len))
+            return false;
+        memcpy(dst, field.value, field.value_len);
+        dst[field.value_len] = '\0';
+    }
+    return form_parser::FORM_DONE == ret && name[0] && password[0];
+}
 
-    // 处理cgi，实现登录和注册校验
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
+// 静态文件: 发送网站根目录下与URL同名的文件，或者发送固定的页面 (/0、/1等跳转页面)
+class static_file_handler : public route_handler
+{
+public:
+    explicit static_file_handler(const char *page = NULL) : m_page(page) {}
+    int handle(http_conn *conn)
     {
-        char flag = m_url[1];    // 根据标志判断是登录检测还是注册检测
+        return conn->serve_file(m_page ? m_page : conn->get_url());
+    }
 
-        // 将网站根目录和url文件拼接
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);   // 把m_url_real所指由NULL结束的字符串的前(FILENAME_LEN-len-1)个字节复制到(m_real_file+len)所指的数组中
-        free(m_url_real);
+private:
+    const char *m_page;
+};
 
-        // 将用户名和密码提取出来 (user=123&passwd=123)
+// /2CGISQL.cgi: POST请求，进行登录校验。验证成功跳转到welcome.html，即资源请求成功页面; 验证失败跳转到logError.html，即登录失败页面
+class login_handler : public route_handler
+{
+public:
+    int handle(http_conn *conn)
+    {
         char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        // /3CGISQL.cgi: POST请求，进行注册校验。注册成功跳转到log.html，即登录页面; 注册失败跳转到registerError.html，即注册失败页面
-        if (*(p + 1) == '3')     
-        {
-            // 如果是注册，先检测数据库中是否有重名的，如果没有重名的，则增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);     
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            // 查询哈希表users，查看该用户名是否注册过
-            if (users.find(name) == users.end())    
-            {
-                m_lock.lock();      // 加锁
-                int res = mysql_query(mysql, sql_insert);             // mysql_query(): 执行一条MySQL查询 (将用户名和密码插入到数据库中)
-                users.insert(pair<string, string>(name, password));   // 同时也插入到哈希表users中
-                m_lock.unlock();    // 解锁
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            }
-            else
-                strcpy(m_url, "/registerError.html");
-        }
-        
-        // /2CGISQL.cgi: POST请求，进行登录校验。验证成功跳转到welcome.html，即资源请求成功页面; 验证失败跳转到logError.html，即登录失败页面
-        else if (*(p + 1) == '2')
+        if (!parse_user(conn, name, password, sizeof(name)))
+            return conn->serve_file("/logError.html");
+
+        m_lock.lock();
+        map<string, string>::iterator it = users.find(name);
+        bool ok = it != users.end() && it->second == password;
+        m_lock.unlock();
+        return conn->serve_file(ok ? "/welcome.html" : "/logError.html");
+    }
+};
+
+// /3CGISQL.cgi: POST请求，进行注册校验。注册成功跳转到log.html，即登录页面; 注册失败跳转到registerError.html，即注册失败页面
+class register_handler : public route_handler
+{
+public:
+    int handle(http_conn *conn)
+    {
+        char name[100], password[100];
+        if (!parse_user(conn, name, password, sizeof(name)))
+            return conn->serve_file("/registerError.html");
+
+        // 如果是注册，先检测数据库中是否有重名的，如果没有重名的，则增加数据 (用户名和密码经过解码，可能含有引号，转义后再拼接到SQL语句中)
+        char name_sql[2 * sizeof(name)], password_sql[2 * sizeof(password)];
+        mysql_real_escape_string(conn->mysql, name_sql, name, strlen(name));
+        mysql_real_escape_string(conn->mysql, password_sql, password, strlen(password));
+        char sql_insert[512];
+        snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, passwd) VALUES('%s', '%s')", name_sql, password_sql);
+
+        // 查询哈希表users，查看该用户名是否注册过
+        const char *page = "/registerError.html";
+        m_lock.lock();      // 加锁
+        if (users.find(name) == users.end())
         {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+            int res = mysql_query(conn->mysql, sql_insert);       // mysql_query(): 执行一条MySQL查询 (将用户名和密码插入到数据库中)
+            users.insert(pair<string, string>(name, password));   // 同时也插入到哈希表users中
+            if (!res)
+                page = "/log.html";
         }
+        m_lock.unlock();    // 解锁
+        return conn->serve_file(page);
     }
+};
 
-    // 如果请求资源为/0，表示跳转到注册界面
-    if (*(p + 1) == '0')
+// /list: GET请求，以分块响应列出网站根目录下的文件 (每批打开一次目录，从上一批结束的位置继续读，进度为已读过的目录项数，读完后为-1)
+class list_handler : public route_handler
+{
+public:
+    int handle(http_conn *conn)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));   // 将网站目录和/log.html进行拼接，更新到m_real_file中
-
-        free(m_url_real);
+        conn->start_chunked(this, "text/plain; charset=utf-8", 0);
+        return http_conn::CHUNKED_RESPONSE;
     }
-    // 如果请求资源为/1，表示跳转到登录界面
-    else if (*(p + 1) == '1')
+    bool next_chunk(http_conn *conn, long long *state)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));   // 将网站目录和/log.html进行拼接，更新到m_real_file中
+        if (*state < 0)
+            return false;
+        DIR *dir = opendir(conn->get_root());
+        if (!dir)
+            return false;
+
+        // 进度为已读过的目录项数: 每批重新打开目录并跳过这些项 (telldir的返回值只对同一个目录流有效，不能用于新打开的目录流)
+        struct dirent *entry;
+        long long index = 0;
+        while (index < *state && readdir(dir))
+            ++index;
 
-        free(m_url_real);
+        char buf[http_conn::MAX_CHUNK];
+        int len = 0;
+        *state = -1;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if ('.' == entry->d_name[0])    // 跳过.、..和隐藏文件
+            {
+                ++index;
+                continue;
+            }
+            int n = strlen(entry->d_name);
+            if (len + n + 1 > (int)sizeof(buf))    // 本批已满，下一批从这一项开始
+            {
+                *state = index;
+                break;
+            }
+            memcpy(buf + len, entry->d_name, n);
+            buf[len + n] = '\n';
+            len += n + 1;
+            ++index;
+        }
+        closedir(dir);
+        conn->add_chunk(buf, len);    // 失败时响应由调用者终止
+        return true;
     }
-    // 如果请求资源为/5，表示跳转到图片请求界面
-    else if (*(p + 1) == '5')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+};
+
+// /upload: POST请求，接收multipart/form-data上传 (上传示例: 只检查文件名，内容不保存，临时文件在on_part返回后即被删除)。
+// 文件名含有路径 (/或\) 或以.开头时终止上传，返回403；全部接收完毕后以分块响应回复"OK"
+class upload_handler : public route_handler
+{
+public:
+    static const long long UPLOAD_LIMIT = 16 << 20;    // 请求体的长度上限，超出时返回413
 
-        free(m_url_real);
+    long long upload_limit()
+    {
+        return UPLOAD_LIMIT;
     }
-    // 如果请求资源为/6，表示跳转到视频请求界面
-    else if (*(p + 1) == '6')
+    bool on_part(http_conn * /*conn*/, const upload_part &part)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-
-        free(m_url_real);
+        return '.' != part.filename[0] && !strpbrk(part.filename, "/\\");
+    }
+    int handle(http_conn *conn)
+    {
+        conn->start_chunked(this, "text/plain; charset=utf-8", 0);
+        return http_conn::CHUNKED_RESPONSE;
     }
-    // 如果请求资源为/7，表示跳转到关注界面
-    else if (*(p + 1) == '7')
+    bool next_chunk(http_conn *conn, long long *state)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        if (*state)
+            return false;
+        conn->add_chunk("OK\n", 3);
+        *state = 1;
+        return true;
+    }
+};
 
-        free(m_url_real);
+// 注册内置路由 (启动时调用一次。之前已注册的同名路由不会被覆盖，因此自定义路由应在此之前注册)
+void http_conn::init_routes()
+{
+    static static_file_handler file_handler;
+    static static_file_handler register_page("/register.html");
+    static static_file_handler log_page("/log.html");
+    static static_file_handler picture_page("/picture.html");
+    static static_file_handler video_page("/video.html");
+    static static_file_handler fans_page("/fans.html");
+    static login_handler login;
+    static register_handler reg;
+    static list_handler list;
+    static upload_handler upload;
+
+    router *r = router::get_instance();
+    const int methods[] = {GET, POST};
+    for (int i = 0; i < 2; ++i)
+    {
+        r->add(methods[i], "/", router::PREFIX, &file_handler);       // 其余请求直接将url与网站目录拼接
+        // 跳转页面只匹配完整路径 (按前缀匹配时/0、/5等开头的文件名，如/5.jpg，会被误当作跳转)
+        r->add(methods[i], "/0", router::EXACT, &register_page);      // /0: 跳转到注册界面
+        r->add(methods[i], "/1", router::EXACT, &log_page);           // /1: 跳转到登录界面
+        r->add(methods[i], "/5", router::EXACT, &picture_page);       // /5: 跳转到图片请求界面
+        r->add(methods[i], "/6", router::EXACT, &video_page);         // /6: 跳转到视频请求界面
+        r->add(methods[i], "/7", router::EXACT, &fans_page);          // /7: 跳转到关注界面
     }
-    // 如果以上均不符合，即不是登录和注册，直接将url与网站目录拼接。这里的情况是welcome界面，请求服务器上的一个图片"judge.html"
-    else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    // 登录和注册 (页面中表单提交到2CGISQL.cgi和3CGISQL.cgi)
+    r->add(POST, "/2", router::EXACT, &login);
+    r->add(POST, "/2CGISQL.cgi", router::EXACT, &login);
+    r->add(POST, "/3", router::EXACT, &reg);
+    r->add(POST, "/3CGISQL.cgi", router::EXACT, &reg);
+    r->add(GET, "/list", router::EXACT, &list);
+    r->add(POST, "/upload", router::EXACT, &upload);
+}
 
-    // 通过stat获取请求资源文件信息。成功则将信息更新到m_file_stat结构体，失败返回NO_RESOURCE状态，表示资源不存在
-    if (stat(m_real_file, &m_file_stat) < 0)     // stat(): 取得指定文件的文件信息
+// 生成响应报文 (按请求方法和URL查找路由，由对应的处理器生成)
+http_conn::HTTP_CODE http_conn::do_request()
+{
+    route_handler *handler = router::get_instance()->find(m_method, m_url, strlen(m_url));
+    if (!handler)
         return NO_RESOURCE;
+    return (HTTP_CODE)handler->handle(this);
+}
 
-    // 判断文件的权限，是否可读，不可读则返回FORBIDDEN_REQUEST状态
-    if (!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;
+// path中是否有".."路径段 (拼接到网站根目录后会指向根目录之外)
+static bool has_dot_segment(const char *path)
+{
+    for (const char *p = path; *p; ++p)
+    {
+        if ('.' == p[0] && '.' == p[1] && (p == path || '/' == p[-1]) && ('/' == p[2] || '\0' == p[2]))
+            return true;
+    }
+    return false;
+}
 
-    // 判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
-    if (S_ISDIR(m_file_stat.st_mode))     // S_ISDIR(): 判断一个路径是否为目录
+// 发送网站根目录下的文件path
+http_conn::HTTP_CODE http_conn::serve_file(const char *path)
+{
+    // 不允许访问网站根目录之外的文件 (在查缓存和stat之前拒绝)
+    if (has_dot_segment(path))
         return BAD_REQUEST;
 
-    // 以只读方式获取文件描述符，通过mmap将该文件映射到内存中
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);    // mmap(): 用于将一个文件或其他对象映射到内存，提高文件的访问速度
-    close(fd);    // 避免文件描述符的浪费和占用
+    // 将网站根目录和path拼接
+    int len = strlen(doc_root);
+    strcpy(m_real_file, doc_root);
+    strncpy(m_real_file + len, path, FILENAME_LEN - len - 1);
+    m_real_file[FILENAME_LEN - 1] = '\0';
+
+    // 命中内存缓存时，响应头和文件内容都已在内存中
+    m_file = NULL;
+    m_blob = blob_cache::get_instance()->lookup(m_real_file);
+    if (m_blob)
+    {
+        m_file_stat = m_blob->st;
+        m_send->blobs[m_blob_count++] = m_blob;
+        if (GET == m_method && not_modified(m_blob->etag, m_blob->etag_len, m_file_stat.st_mtime))
+            return NOT_MODIFIED;
+        return parse_range(m_blob->etag);
+    }
+
+    // 命中文件缓存时直接使用缓存的文件信息、文件描述符或映射和响应头，不需要任何文件系统调用
+    m_file = file_cache::get_instance()->lookup(m_real_file);
+    if (!m_file)
+    {
+
+        // 通过stat获取请求资源文件信息。成功则将信息更新到m_file_stat结构体，失败返回NO_RESOURCE状态，表示资源不存在
+        if (stat(m_real_file, &m_file_stat) < 0)     // stat(): 取得指定文件的文件信息
+            return NO_RESOURCE;
+
+        // 判断文件的权限，是否可读，不可读则返回FORBIDDEN_REQUEST状态
+        if (!(m_file_stat.st_mode & S_IROTH))
+            return FORBIDDEN_REQUEST;
 
-    return FILE_REQUEST;    //表示请求文件存在，且可以访问
+        // 判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
+        if (S_ISDIR(m_file_stat.st_mode))     // S_ISDIR(): 判断一个路径是否为目录
+            return BAD_REQUEST;
+
+        // 打开文件并加入缓存: 大文件保持打开，发送时由sendfile从页缓存直接写入socket (发送线程不会因访问映射内存而缺页)；小文件通过mmap映射到内存中，与响应头一次writev发出
+        m_file = file_cache::get_instance()->load(m_real_file, m_file_stat, m_sendfile_threshold);
+        if (!m_file)
+            return INTERNAL_ERROR;
+    }
+    m_file_stat = m_file->st;
+    m_send->files[m_file_count++] = m_file;
+    if (GET == m_method && not_modified(m_file->etag, m_file->etag_len, m_file_stat.st_mtime))
+        return NOT_MODIFIED;
+
+    // 经常访问的中小文件复制到内存缓存中 (由准入策略决定)，本次响应即从中发送
+    m_blob = blob_cache::get_instance()->admit(m_file);
+    if (m_blob)
+        m_send->blobs[m_blob_count++] = m_blob;
+
+    return parse_range(m_file->etag);    //表示请求文件存在，且可以访问 (请求了部分内容时为PARTIAL_CONTENT)
+}
+
+
+// 逗号分隔的实体标签列表中是否有与etag匹配的 (弱比较: 忽略W/前缀，压缩版本的"-编码名"后缀也算匹配)
+static bool etag_match(const char *p, const char *end, const char *etag, int etag_len)
+{
+    while (p < end)
+    {
+        while (p < end && (' ' == *p || '\t' == *p || ',' == *p))
+            ++p;
+        if (end - p >= 1 && '*' == *p)
+            return true;
+        if (end - p >= 2 && 'W' == p[0] && '/' == p[1])
+            p += 2;
+        if (p >= end || '"' != *p)
+            return false;
+        const char *tag = ++p;
+        const char *quote = (const char *)memchr(tag, '"', end - tag);
+        if (!quote)
+            return false;
+        int len = quote - tag;
+        if (len >= etag_len && memcmp(tag, etag, etag_len) == 0 && (len == etag_len || '-' == tag[etag_len]))
+            return true;
+        p = quote + 1;
+    }
+    return false;
+}
+
+bool http_conn::not_modified(const char *etag, int etag_len, time_t mtime)
+{
+    header_view inm = get_header(HDR_IF_NONE_MATCH);
+    if (inm.str)
+        return etag_match(inm.str, inm.str + inm.len, etag, etag_len);
+    header_view ims = get_header(HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    if (ims.str && http_date::parse(ims.str, ims.len, &since))
+        return mtime <= since;
+    return false;
 }
 
 
-// 取消目标文件到内存的映射
-void http_conn::unmap()
+// 区间按起始位置排序 (插入排序，区间数很少)
+static void sort_ranges(long long (*r)[2], int n)
+{
+    for (int i = 1; i < n; ++i)
+    {
+        long long first = r[i][0], last = r[i][1];
+        int j = i - 1;
+        for (; j >= 0 && r[j][0] > first; --j)
+        {
+            r[j + 1][0] = r[j][0];
+            r[j + 1][1] = r[j][1];
+        }
+        r[j + 1][0] = first;
+        r[j + 1][1] = last;
+    }
+}
+
+// 解析非负十进制整数 (不允许空串和溢出)
+static bool parse_offset(const char *p, const char *end, long long *value)
+{
+    if (p == end)
+        return false;
+    long long v = 0;
+    for (; p < end; ++p)
+    {
+        if (*p < '0' || *p > '9' || v > (LLONG_MAX - 9) / 10)
+            return false;
+        v = v * 10 + (*p - '0');
+    }
+    *value = v;
+    return true;
+}
+
+http_conn::HTTP_CODE http_conn::parse_range(const char *etag)
 {
-    if (m_file_address)
+    m_range_count = 0;
+    long long size = m_file_stat.st_size;
+    header_view range = get_header(HDR_RANGE);
+    if (GET != m_method || !range.str || size <= 0)
+        return FILE_REQUEST;
+
+    // If-Range: 校验值 (强比较) 或修改时间与当前文件一致时Range才生效，否则发送整个文件
+    header_view if_range = get_header(HDR_IF_RANGE);
+    if (if_range.str)
     {
-        munmap(m_file_address, m_file_stat.st_size);   // munmap: 释放由mmap创建的这段内存空间
-        m_file_address = 0;
+        int etag_len = strlen(etag);
+        if ('"' == if_range.str[0])
+        {
+            if (if_range.len != etag_len + 2 || memcmp(if_range.str + 1, etag, etag_len) != 0 || '"' != if_range.str[etag_len + 1])
+                return FILE_REQUEST;
+        }
+        else
+        {
+            time_t t;
+            if (!http_date::parse(if_range.str, if_range.len, &t) || t != m_file_stat.st_mtime)
+                return FILE_REQUEST;
+        }
     }
+
+    // bytes=首-尾, 首-, -后缀长度 (以','分隔)。语法错误时忽略Range字段，超出文件范围的区间被丢弃
+    const char *p = range.str, *end = range.str + range.len;
+    if (range.len < 6 || strncasecmp(p, "bytes=", 6) != 0)
+        return FILE_REQUEST;
+    p += 6;
+    int count = 0;
+    long long ranges[MAX_RANGES][2];
+    while (p < end)
+    {
+        const char *item_end = (const char *)memchr(p, ',', end - p);
+        if (!item_end)
+            item_end = end;
+        while (p < item_end && (' ' == *p || '\t' == *p))
+            ++p;
+        const char *e = item_end;
+        while (e > p && (' ' == e[-1] || '\t' == e[-1]))
+            --e;
+        const char *dash = (const char *)memchr(p, '-', e - p);
+        if (p == e)    // 空项 (如连续的',') 忽略
+        {
+            p = item_end + 1;
+            continue;
+        }
+        if (!dash)
+            return FILE_REQUEST;
+
+        long long first, last;
+        if (dash == p)
+        {
+            if (!parse_offset(dash + 1, e, &last))
+                return FILE_REQUEST;
+            if (0 == last)    // 长度为0的后缀不可满足
+            {
+                p = item_end + 1;
+                continue;
+            }
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        }
+        else
+        {
+            if (!parse_offset(p, dash, &first))
+                return FILE_REQUEST;
+            if (dash + 1 == e)
+                last = size - 1;
+            else if (!parse_offset(dash + 1, e, &last) || last < first)
+                return FILE_REQUEST;
+            if (last >= size)
+                last = size - 1;
+        }
+        if (first < size)
+        {
+            if (count == MAX_RANGES)
+                return FILE_REQUEST;
+            ranges[count][0] = first;
+            ranges[count][1] = last;
+            count++;
+        }
+        p = item_end + 1;
+    }
+    if (0 == count)
+        return RANGE_NOT_SATISFIABLE;
+
+    // 合并重叠或相邻的区间 (避免同一段内容被重复发送)
+    sort_ranges(ranges, count);
+    m_send->ranges[0][0] = ranges[0][0];
+    m_send->ranges[0][1] = ranges[0][1];
+    m_range_count = 1;
+    for (int i = 1; i < count; ++i)
+    {
+        long long *prev = m_send->ranges[m_range_count - 1];
+        if (ranges[i][0] <= prev[1] + 1)
+        {
+            if (ranges[i][1] > prev[1])
+                prev[1] = ranges[i][1];
+        }
+        else
+        {
+            m_send->ranges[m_range_count][0] = ranges[i][0];
+            m_send->ranges[m_range_count][1] = ranges[i][1];
+            m_range_count++;
+        }
+    }
+    return PARTIAL_CONTENT;
+}
+
+
+// 释放待发送的响应引用的文件缓存项 (文件已被替换或淘汰时，最后一个引用释放后才取消映射或关闭文件)
+void http_conn::release_files()
+{
+    for (int i = 0; i < m_file_count; ++i)
+        file_cache::release(m_send->files[i]);
+    m_file_count = 0;
+    m_file = NULL;
+    for (int i = 0; i < m_blob_count; ++i)
+        blob_cache::release(m_send->blobs[i]);
+    m_blob_count = 0;
+    m_blob = NULL;
 }
 
 
 // 写入响应报文    
 bool http_conn::write()
 {
-    int temp = 0;
+    ssize_t temp = 0;
 
     //若要发送的数据长度为0，表示响应报文为空，一般不会出现这种情况
     if (bytes_to_send == 0)
     {
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);    // 重新注册可读事件 (开启EPOLLONESHOT)
-        init();                                             // 重新初始化HTTP对象
         return true;
     }
 
     while (1)
     {
-        // 将响应报文的状态行、消息头、空行和响应正文发送给浏览器端
-        temp = writev(m_sockfd, m_iv, m_iv_count);     // writev(): 以顺序iov[0],iov[1]至iov[iovcnt-1]从缓冲区中聚集输出数据，返回输出的字节总数
+        // 从第一个未发送完的块开始 (此前的块长度已被update_iv置0)
+        int i = 0;
+        while (0 == m_send->iv[i].iov_len)
+            ++i;
+
+        if (m_send->iv_fd[i] >= 0)
+        {
+            // 文件内容由内核从页缓存直接发送到socket，不经过用户空间
+            off_t offset = m_send->iv_off[i];
+            temp = sendfile(m_sockfd, m_send->iv_fd[i], &offset, m_send->iv[i].iov_len);
+            if (0 == temp)    // 文件在发送过程中被截短，无法再发出Content-Length声明的长度
+            {
+                release_files();
+                return false;
+            }
+        }
+        else
+        {
+            // 将响应报文的状态行、消息头、空行和响应正文 (直到下一个sendfile块为止) 聚集发送给浏览器端，与writev相同
+            int j = i;
+            while (j < m_iv_count && m_send->iv_fd[j] < 0)
+                ++j;
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = m_send->iv + i;
+            msg.msg_iovlen = j - i;
+            // 后面紧跟sendfile发送的文件时带上MSG_MORE (相当于临时开启TCP_CORK)，响应头与文件开头合并成满长度的报文段发出，而不是单独发一个小包
+            temp = sendmsg(m_sockfd, &msg, j < m_iv_count ? MSG_MORE : 0);
+        }
 
         if (temp < 0)
         {
@@ -603,38 +1417,31 @@ bool http_conn::write()
                 return true;
             }
 
-            unmap();    // 如果发送失败，但不是缓冲区问题，取消映射，关闭连接
+            release_files();    // 如果发送失败，但不是缓冲区问题，释放文件，关闭连接
             return false;
         }
 
-        // 更新已发送字节数和待发送字节数
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
+        update_iv(temp);   // 更新已发送字节数、待发送字节数和iovec
 
-        // 第一个iovec头部信息的数据已发送完，发送第二个iovec数据
-        if (bytes_have_send >= m_iv[0].iov_len)
-        {
-            m_iv[0].iov_len = 0;   // 不再继续发送头部信息
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        // 否则，继续发送第一个iovec头部信息的数据
-        else
+        // 分块响应还没有生成完，继续生成下一批
+        if (bytes_to_send <= 0 && m_stream && !next_stream())
         {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
+            release_files();
+            return false;
         }
 
         // 判断数据是否已全部发送完
         if (bytes_to_send <= 0)
         {
-            unmap();                                            // 取消映射
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);    // 重新注册可读事件 (开启EPOLLONESHOT)
+            bool keep_alive = m_keep_alive;
+            init_response();                                    // 释放文件，重置发送状态 (读缓冲区中尚未处理的流水线请求保留)
 
             // 判断浏览器的请求是否为长连接
-            if (m_linger)
+            if (keep_alive)
             {
-                init();    // 如果是长连接，则重新初始化HTTP对象
+                // 重新注册可读事件 (开启EPOLLONESHOT。短连接即将被关闭，不再注册，避免关闭前又触发新事件)。读缓冲区中还有请求时由调用者继续处理
+                if (!has_buffered_request())
+                    modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
                 return true;
             }
             else
@@ -646,152 +1453,509 @@ bool http_conn::write()
 }
 
 
-// 用于更新m_write_idx指针和缓冲区m_write_buf中的内容
-bool http_conn::add_response(const char *format, ...)
+// 追加一段待发送数据 (与上一段在内存中相邻时直接合并，如连续的无文件响应都在写缓冲区中)
+void http_conn::add_iv(char *base, long long len)
 {
-     // 如果写入内容超出m_write_buf大小则报错
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
+    if (m_iv_count > 0 && m_send->iv_fd[m_iv_count - 1] < 0 && (char *)m_send->iv[m_iv_count - 1].iov_base + m_send->iv[m_iv_count - 1].iov_len == base)
+    {
+        m_send->iv[m_iv_count - 1].iov_len += len;
+        return;
+    }
+    m_send->iv[m_iv_count].iov_base = base;
+    m_send->iv[m_iv_count].iov_len = len;
+    m_send->iv_fd[m_iv_count] = -1;
+    m_iv_count++;
+}
+
+// 追加一段由sendfile发送的文件内容 (从文件的off处发送len字节)
+void http_conn::add_file_iv(int fd, off_t off, off_t len)
+{
+    m_send->iv[m_iv_count].iov_base = NULL;
+    m_send->iv[m_iv_count].iov_len = len;
+    m_send->iv_fd[m_iv_count] = fd;
+    m_send->iv_off[m_iv_count] = off;
+    m_iv_count++;
+}
 
-    va_list arg_list;             // 定义可变参数列表
-    va_start(arg_list, format);   // 将变量arg_list初始化为传入参数
-    // 将数据format从可变参数列表写入缓冲区，返回写入数据的长度
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);    // vsnprintf(): 将可变参数格式化输出到一个字符数组
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))    // 如果写入的数据长度超过缓冲区剩余空间，则报错
+// 区间内容优先从内存缓存发送 (内存缓存中的原文)，其次是映射的文件，大文件由sendfile按偏移发送
+void http_conn::add_range_iv(long long first, long long len)
+{
+    if (m_blob)
+        add_iv(m_blob->variant[ENC_IDENTITY].body + first, len);
+    else if (m_file->fd >= 0)
+        add_file_iv(m_file->fd, first, len);
+    else
+        add_iv(m_file->addr + first, len);
+}
+
+// 发送bytes字节后，更新已发送字节数、待发送字节数和iovec
+void http_conn::update_iv(long long bytes)
+{
+    // 更新已发送字节数和待发送字节数
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+
+    // 已发送完的iovec长度置0，第一个未发送完的iovec从未发送的位置开始
+    for (int i = 0; i < m_iv_count && bytes > 0; ++i)
     {
-        va_end(arg_list);
-        return false;
+        if ((size_t)bytes >= m_send->iv[i].iov_len)
+        {
+            bytes -= m_send->iv[i].iov_len;
+            m_send->iv[i].iov_len = 0;
+        }
+        else
+        {
+            if (m_send->iv_fd[i] >= 0)
+                m_send->iv_off[i] += bytes;
+            else
+                m_send->iv[i].iov_base = (char *)m_send->iv[i].iov_base + bytes;
+            m_send->iv[i].iov_len -= bytes;
+            bytes = 0;
+        }
+    }
+}
+
+// io_uring后端: 接收到bytes字节后解析请求
+int http_conn::read_done(int bytes)
+{
+    if (bytes < 0)
+        return -1;
+    m_read_idx += bytes;
+    m_read_buf[m_read_idx] = '\0';
+
+    int ret = process_requests();
+    if (0 == ret && !reserve_read())
+        return -1;   // 读缓冲区已达上限仍不完整，关闭连接
+    return ret;
+}
+
+// io_uring后端: 数据在缓冲区环的缓冲区中 (按需借用或扩大读缓冲区，复制后解析请求)
+int http_conn::read_done(const char *data, int bytes)
+{
+    while (bytes > 0)
+    {
+        if (!reserve_read())
+            return -1;    // 请求报文超过READ_BUFFER_SIZE仍不完整
+        int n = m_read_size - m_read_idx < bytes ? m_read_size - m_read_idx : bytes;
+        memcpy(m_read_buf + m_read_idx, data, n);
+        m_read_idx += n;
+        data += n;
+        bytes -= n;
+    }
+    return read_done(0);
+}
+
+// io_uring后端: 发送了bytes字节后更新发送状态
+int http_conn::write_done(int bytes)
+{
+    if (bytes < 0)
+    {
+        release_files();
+        return -1;
     }
-    m_write_idx += len;   // 更新m_write_idx位置
-    va_end(arg_list);     // 清空可变参列表
- 
-    LOG_INFO("request:%s", m_write_buf);     // log打印输出内容
 
+    update_iv(bytes);
+    if (bytes_to_send <= 0 && m_stream && !next_stream())
+    {
+        release_files();
+        return -1;
+    }
+    if (bytes_to_send > 0)
+        return 1;
+
+    bool keep_alive = m_keep_alive;
+    init_response();
+    return keep_alive ? 0 : -1;
+}
+
+// 连接当前所处阶段对应的超时类型
+int http_conn::timeout_type()
+{
+    if (bytes_to_send > 0)
+        return TIMEOUT_WRITE;
+    if (CHECK_STATE_CONTENT == m_check_state)
+        return TIMEOUT_BODY;
+    if (0 == m_read_idx && m_request_count > 0)
+        return TIMEOUT_IDLE;
+    return TIMEOUT_HEADER;
+}
+
+// 向写缓冲区m_write_buf中追加len字节 (当前块剩余空间不足时借用新块，超过上限则报错)
+bool http_conn::add_bytes(const char *data, int len)
+{
+    if (len > m_write_buf.avail() && !m_write_buf.reserve(len))
+        return false;
+    memcpy(m_write_buf.tail(), data, len);
+    m_write_buf.commit(len);
     return true;
 }
+bool http_conn::add_str(const char *str)
+{
+    return add_bytes(str, strlen(str));
+}
+// 十进制整数 (从低位向高位写入临时数组，再整体复制)
+bool http_conn::add_number(long long value)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    unsigned long long v = value < 0 ? -(unsigned long long)value : value;
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (value < 0)
+        *--p = '-';
+    return add_bytes(p, buf + sizeof(buf) - p);
+}
+// 十进制整数的位数 (预先计算多区间响应的总长度)
+static int number_len(long long value)
+{
+    int n = 1;
+    for (; value >= 10; value /= 10)
+        ++n;
+    return n;
+}
 
 // 添加状态行
 bool http_conn::add_status_line(int status, const char *title)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    return add_bytes("HTTP/1.1 ", 9) && add_number(status) && add_bytes(" ", 1) && add_str(title) && add_bytes("\r\n", 2);
 }
-// 添加消息报头 (具体的添加文本长度、连接状态和空行)
+// 添加消息报头 (具体的添加文本长度、通用字段、连接状态和空行)
 bool http_conn::add_headers(int content_len)
 {
-    return add_content_length(content_len) && add_linger() &&
-           add_blank_line();
+    return add_content_length(content_len) && end_headers();
 }
 // 添加Content-Length，表示响应报文的长度
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content_length(long long content_len)
+{
+    return add_bytes("Content-Length:", 15) && add_number(content_len) && add_bytes("\r\n", 2);
+}
+// 添加文本类型
+bool http_conn::add_content_type(const char *type)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    return add_bytes("Content-Type:", 13) && add_str(type) && add_bytes("\r\n", 2);
 }
-// 添加文本类型 (这里是html)
-bool http_conn::add_content_type()
+// 添加Date和Server字段 (Date由http_date每秒格式化一次)
+bool http_conn::add_general_headers()
 {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_bytes("Date:", 5) && add_bytes(http_date::now(), http_date::LEN) && add_bytes("\r\nServer:MyWebServer\r\n", 22);
 }
 // 添加连接状态 (通知浏览器端是保持连接还是关闭)
 bool http_conn::add_linger()
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    return m_linger ? add_bytes("Connection:keep-alive\r\n", 23) : add_bytes("Connection:close\r\n", 18);
 }
 // 添加空行
 bool http_conn::add_blank_line()
 {
-    return add_response("%s", "\r\n");
+    return add_bytes("\r\n", 2);
+}
+// 结束响应头 (通用字段、连接状态和空行，所有响应都以此结尾)
+bool http_conn::end_headers()
+{
+    return add_general_headers() && add_linger() && add_blank_line();
 }
 // 添加文本content
 bool http_conn::add_content(const char *content)
 {
-    return add_response("%s", content);
+    return add_str(content);
+}
+// 写缓冲区中正在生成的数据交给iovec (body_len为随后追加的响应体长度，一并计入待发送字节数)
+void http_conn::flush_write_buf(long long body_len)
+{
+    bytes_to_send += m_write_buf.pending() + body_len;
+    add_iv(m_write_buf.start(), m_write_buf.pending());
+    m_write_buf.seal();
 }
 
 
-// 为发送响应报文做准备 (向m_write_buf写入响应报文数据，第一个iovec指针指向响应报文缓冲区，第二个iovec指针指向mmap返回的文件指针)
-bool http_conn::process_write(HTTP_CODE ret)
+// 开始分块响应 (在handle中调用，响应头在process_write中生成)
+void http_conn::start_chunked(route_handler *producer, const char *type, long long state)
 {
-    switch (ret)
+    m_stream = producer;
+    m_stream_state = state;
+    m_stream_type = type;
+    m_stream_chunked = m_http11;
+    m_stream_error = false;
+}
+
+// 每段内容前为十六进制的长度和"\r\n"，之后为"\r\n" (长度为0时不追加，否则会被当作结尾的空块)
+bool http_conn::add_chunk(const char *data, int len)
+{
+    if (len < 0 || len > MAX_CHUNK)
     {
-    case INTERNAL_ERROR:     // 内部错误，500
+        m_stream_error = true;
+        return false;
+    }
+    if (0 == len)
+        return true;
+    char size[8];
+    int n = 0;
+    if (m_stream_chunked)
     {
-        add_status_line(500, error_500_title);   // 状态行
-        add_headers(strlen(error_500_form));     // 消息头
-        if (!add_content(error_500_form))        // 消息体
-            return false;
-        break;
+        for (int shift = 16; shift >= 0; shift -= 4)    // MAX_CHUNK以内最多5位
+        {
+            if (n > 0 || (len >> shift) || 0 == shift)
+                size[n++] = "0123456789abcdef"[(len >> shift) & 15];
+        }
+        size[n++] = '\r';
+        size[n++] = '\n';
     }
-    case BAD_REQUEST:        // 报文语法有误，404
+    if (!m_write_buf.reserve(n + len + 2) || !add_bytes(size, n) || !add_bytes(data, len) || (m_stream_chunked && !add_bytes("\r\n", 2)))
     {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
-            return false;
-        break;
+        m_stream_error = true;
+        return false;
     }
-    case FORBIDDEN_REQUEST:  // 资源没有访问权限，403
+    return true;
+}
+
+// 写缓冲区中累积到MAX_CHUNK字节或处理器结束时，交给iovec发送；处理器结束时追加结尾的空块
+bool http_conn::fill_stream()
+{
+    while (m_write_buf.pending() < MAX_CHUNK)
     {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        bool more = m_stream->next_chunk(this, &m_stream_state);
+        if (m_stream_error)
+        {
+            m_stream = NULL;
             return false;
-        break;
+        }
+        if (!more)
+        {
+            m_stream = NULL;
+            if (m_stream_chunked && !add_bytes("0\r\n\r\n", 5))
+                return false;
+            break;
+        }
     }
+    flush_write_buf(0);
+    return true;
+}
+
+bool http_conn::next_stream()
+{
+    // 同一批中在分块响应之前的流水线响应都已发送完毕，一并释放
+    release_files();
+    m_write_buf.clear();
+    m_iv_count = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    return fill_stream();
+}
+
+// 追加一个预先生成的响应 (响应头复制到写缓冲区并补上通用字段和Connection字段，内容由iovec直接指向)
+bool http_conn::add_canned(const canned_response &response)
+{
+    if (!add_bytes(response.head.data(), response.head.size()) || !end_headers())
+        return false;
+    flush_write_buf(response.body_len);
+    add_iv((char *)response.body, response.body_len);
+    return true;
+}
+
+// 为发送响应报文做准备 (向m_write_buf写入响应头，响应体 (内存缓存、映射的文件、sendfile或固定内容) 由之后的iovec指向。流水线请求的响应依次追加在写缓冲区中)
+bool http_conn::process_write(HTTP_CODE ret)
+{
+    switch (ret)
+    {
+    case INTERNAL_ERROR:     // 内部错误，500
+        return add_canned(response_500);
+    case BAD_REQUEST:        // 报文语法有误，400
+        m_linger = false;    // 无法确定下一个请求的起始位置，发送完即关闭连接
+        return add_canned(response_400);
+    case NO_RESOURCE:        // 请求的文件不存在，404
+        return add_canned(response_404);
+    case FORBIDDEN_REQUEST:  // 资源没有访问权限，403
+        return add_canned(response_403);
+    case REQUEST_TOO_LARGE:  // 上传的请求体过大，413
+        m_linger = false;    // 请求体没有接收，发送完即关闭连接
+        return add_canned(response_413);
     case FILE_REQUEST:       // 文件存在，200
     {
-        add_status_line(200, ok_200_title);   
-
+        // 文件在内存缓存中: 按Accept-Encoding选择最小的可接受版本，复制缓存的响应头，内容直接从内存缓存发送
+        if (m_blob)
+        {
+            header_view ae = get_header(HDR_ACCEPT_ENCODING);
+            const blob_variant *v = blob_cache::select(m_blob, ae.str ? accepted_encodings(ae.str, ae.len) : 0);
+            if (!add_bytes(v->header, v->header_len) || !end_headers())
+                return false;
+            flush_write_buf(v->size);
+            add_iv(v->body, v->size);
+            return true;
+        }
         // 如果请求的资源存在
         if (m_file_stat.st_size != 0)
         {
-            add_headers(m_file_stat.st_size);
-            // 第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            // 第二个iovec指针指向mmap返回的文件指针，长度指向文件大小
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;   // 发送的全部数据为响应报文头部信息和文件大小
+            // 状态行和各字段在缓存项中预先生成
+            if (!add_bytes(m_file->header, m_file->header_len) || !end_headers())
+                return false;
+            // 第一个iovec指针指向写缓冲区中本响应的头部，第二个iovec指针指向mmap返回的文件指针 (或由sendfile发送的文件)，长度为文件大小
+            flush_write_buf(m_file_stat.st_size);   // 发送的全部数据为响应报文头部信息和文件大小
+            if (m_file->fd >= 0)
+                add_file_iv(m_file->fd, 0, m_file_stat.st_size);
+            else
+                add_iv(m_file->addr, m_file_stat.st_size);
             return true;
         }
         // 如果请求的资源不存在，则返回空白html文件
-        else
+        return add_canned(response_empty);
+    }
+    case PARTIAL_CONTENT:    // 文件的部分内容，206 (区间总是取自原文，与Accept-Encoding无关)
+    {
+        long long size = m_file_stat.st_size;
+        const char *etag = m_file ? m_file->etag : m_blob->etag;
+        const char *validators = m_file ? m_file->validators : m_blob->validators;
+        const char *type = m_file ? m_file->type : m_blob->type;
+        bool vary = compressible(m_real_file, strlen(m_real_file));
+        if (1 == m_range_count)
         {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
+            long long first = m_send->ranges[0][0], len = m_send->ranges[0][1] - first + 1;
+            if (!add_status_line(206, ok_206_title) || !add_content_length(len) || !add_content_type(type) || !add_bytes("Accept-Ranges:bytes\r\n", 21) ||
+                !add_bytes("Content-Range:bytes ", 20) || !add_number(first) || !add_bytes("-", 1) || !add_number(m_send->ranges[0][1]) ||
+                !add_bytes("/", 1) || !add_number(size) || !add_bytes("\r\n", 2) ||
+                !add_validators(etag, NULL, validators, vary) || !end_headers())
                 return false;
+            flush_write_buf(len);
+            add_range_iv(first, len);
+            return true;
+        }
+
+        // 多个区间: multipart/byteranges，每个区间前有一段分隔符、Content-Type和Content-Range，最后以结束分隔符结尾 (各部分的长度预先算出，得到总的Content-Length)
+        int boundary_len = strlen(byteranges_boundary), type_len = strlen(type);
+        long long total = 8 + boundary_len;    // "\r\n--" boundary "--\r\n"
+        for (int i = 0; i < m_range_count; ++i)
+            total += 4 + boundary_len + 15 + type_len + 22 + number_len(m_send->ranges[i][0]) + 1 + number_len(m_send->ranges[i][1]) + 1 + number_len(size) + 4 +
+                     m_send->ranges[i][1] - m_send->ranges[i][0] + 1;
+        // 预先保证写缓冲区的空间足够容纳所有分隔头，避免已追加部分iovec后才失败
+        if (!m_write_buf.reserve(1024 + m_range_count * (128 + type_len)))
+            return false;
+        if (!add_status_line(206, ok_206_title) || !add_content_length(total) ||
+            !add_bytes("Content-Type:multipart/byteranges; boundary=", 44) || !add_str(byteranges_boundary) || !add_bytes("\r\nAccept-Ranges:bytes\r\n", 23) ||
+            !add_validators(etag, NULL, validators, vary) || !end_headers())
+            return false;
+        for (int i = 0; i < m_range_count; ++i)
+        {
+            if (!add_bytes("\r\n--", 4) || !add_str(byteranges_boundary) || !add_bytes("\r\nContent-Type:", 15) || !add_str(type) ||
+                !add_bytes("\r\nContent-Range:bytes ", 22) || !add_number(m_send->ranges[i][0]) || !add_bytes("-", 1) || !add_number(m_send->ranges[i][1]) ||
+                !add_bytes("/", 1) || !add_number(size) || !add_bytes("\r\n\r\n", 4))
+                return false;
+            flush_write_buf(m_send->ranges[i][1] - m_send->ranges[i][0] + 1);
+            add_range_iv(m_send->ranges[i][0], m_send->ranges[i][1] - m_send->ranges[i][0] + 1);
         }
+        if (!add_bytes("\r\n--", 4) || !add_str(byteranges_boundary) || !add_bytes("--\r\n", 4))
+            return false;
+        break;
+    }
+    case RANGE_NOT_SATISFIABLE:    // 请求的区间都超出了文件范围，416
+    {
+        if (!add_status_line(416, error_416_title) || !add_bytes("Content-Range:bytes */", 22) || !add_number(m_file_stat.st_size) ||
+            !add_bytes("\r\n", 2) || !add_headers(0))
+            return false;
+        break;
+    }
+    case NOT_MODIFIED:       // 客户端缓存仍然有效，304 (只有响应头，ETag与200响应中选择的版本一致)
+    {
+        int encoding = ENC_IDENTITY;
+        const char *validators = m_file ? m_file->validators : m_blob->validators;
+        const char *etag = m_file ? m_file->etag : m_blob->etag;
+        if (m_blob)
+        {
+            header_view ae = get_header(HDR_ACCEPT_ENCODING);
+            encoding = blob_cache::select(m_blob, ae.str ? accepted_encodings(ae.str, ae.len) : 0) - m_blob->variant;
+        }
+        if (!add_status_line(304, ok_304_title) ||
+            !add_validators(etag, encoding ? encoding_name(encoding) : NULL, validators, compressible(m_real_file, strlen(m_real_file))) ||
+            !end_headers())
+            return false;
+        break;
+    }
+    case CHUNKED_RESPONSE:   // 由处理器分块生成的内容，200 (先发送响应头和第一批内容，其余的在发送完毕后继续生成)
+    {
+        if (!m_stream_chunked)
+            m_linger = false;    // HTTP/1.0客户端不支持chunked，以关闭连接表示内容结束
+        if (!add_status_line(200, ok_200_title) || !add_content_type(m_stream_type) ||
+            (m_stream_chunked && !add_bytes("Transfer-Encoding:chunked\r\n", 27)) || !end_headers())
+            return false;
+        return fill_stream();
     }
     default:
         return false;
     }
 
-    // 除FILE_REQUEST状态外，其余状态只申请一个iovec，指向响应报文缓冲区
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    // 其余状态的响应 (或其最后一段) 都在写缓冲区中
+    flush_write_buf(0);
     return true;
 }
 
+// 添加Vary、ETag (压缩版本带"-编码名"后缀) 和validators (Last-Modified、Cache-Control)
+bool http_conn::add_validators(const char *etag, const char *encoding, const char *validators, bool vary)
+{
+    if (vary && !add_bytes("Vary:Accept-Encoding\r\n", 22))
+        return false;
+    if (!add_bytes("ETag:\"", 6) || !add_str(etag))
+        return false;
+    if (encoding && (!add_bytes("-", 1) || !add_str(encoding)))
+        return false;
+    return add_bytes("\"\r\n", 3) && add_str(validators);
+}
+
+// 依次处理读缓冲区中的请求 (客户端可能不等响应就连续发送多个请求，即HTTP流水线。每个请求生成响应后继续解析下一个，所有响应合并到同一组iovec中由一次writev发出)
+int http_conn::process_requests()
+{
+    // iovec、响应引用的缓存项和Range区间只在生成和发送响应期间需要
+    if (!m_send && !(m_send = borrow<send_state>()))
+        return -1;
+    while (true)
+    {
+        HTTP_CODE read_ret = process_read();    // HTTP报文解析
+        if (read_ret == NO_REQUEST)
+            break;
+
+        if (m_max_requests > 0 && m_request_count + 1 >= m_max_requests)
+            m_linger = false;        // 已达到单连接请求数上限，本响应告知客户端并在发送完毕后关闭连接
+
+        if (!process_write(read_ret))           // HTTP报文响应
+        {
+            if (0 == m_response_count)
+                return -1;
+            m_keep_alive = false;    // 之前生成的响应照常发送，发送完毕后关闭连接
+            break;
+        }
+        m_request_count++;
+        m_response_count++;
+        m_keep_alive = m_linger;
+        if (!m_linger)               // 短连接发送完即关闭，其后的数据不再处理
+            break;
+
+        init_request();
+        // 读缓冲区中没有更多数据，或响应数达到上限、剩余的iovec可能不够下一个响应使用时，先发送已生成的响应 (剩余请求在发送完毕后继续处理)
+        // 分块响应要等内容全部生成并发送完毕，之后的请求也在那时再处理
+        if (0 == m_read_idx || m_response_count >= MAX_PIPELINE || m_iv_count + MAX_RANGES * 2 + 1 > MAX_IOV || m_stream)
+            break;
+    }
+    if (0 == m_response_count)
+        give_back(m_send);           // 请求还不完整，等待期间不占用发送状态块
+    return m_response_count > 0 ? 1 : 0;
+}
+
 
 // 线程通过process函数对任务进行处理 (处理客户请求)
 void http_conn::process()
 {
-    HTTP_CODE read_ret = process_read();         // HTTP报文解析
-    // NO_REQUEST，表示请求不完整，需要继续接收请求数据
-    if (read_ret == NO_REQUEST)
+    int ret = process_requests();    // HTTP报文解析和响应
+    // 0，表示请求不完整，需要继续接收请求数据
+    if (0 == ret)
     {
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);   // 重新注册可读事件 (开启EPOLLONESHOT)
         return;
     }
 
-    bool write_ret = process_write(read_ret);   // HTTP报文响应 (此时表示接收并解析了一个完整的请求)
-    if (!write_ret)
+    if (ret < 0)
     {
-        close_conn();
+        // 不在此处直接关闭: shutdown后重新注册的事件会带上EPOLLRDHUP，由事件循环删除定时器并关闭连接 (否则fd被复用后定时器仍指向它)
+        shutdown(m_sockfd, SHUT_RDWR);
     }
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);      // 注册可写事件 (开启EPOLLONESHOT)
 }
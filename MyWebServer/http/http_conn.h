@@ -19,19 +19,37 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
+#include <new>
 
 #include "../lock/locker.h"
+#include "../buffer/buffer_pool.h"
+#include "../cache/file_cache.h"
+#include "../cache/blob_cache.h"
+#include "http_header.h"
+#include "http_router.h"
+#include "multipart.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
 
+struct canned_response;
+class completion_queue;
+
+// 重新注册connfd上的EPOLLONESHOT事件 (定义在http_conn.cpp)
+void modfd(int epollfd, int fd, int ev, int TRIGMode);
+
 class http_conn
 {
 public:
     static const int FILENAME_LEN = 200;           // 设置读取文件的名称m_real_file大小
-    static const int READ_BUFFER_SIZE = 2048;      // 设置读缓冲区m_read_buf大小
-    static const int WRITE_BUFFER_SIZE = 1024;     // 设置写缓冲区m_write_buf大小
+    static const int READ_BUFFER_SIZE = buffer_pool::MAX_SIZE;   // 读缓冲区m_read_buf的最大容量 (从缓冲区池按需借用，由2KB起逐级扩大，即请求报文的最大长度)
+    static const int MAX_PIPELINE = 8;             // 一次writev最多合并的流水线响应数
+    static const int MAX_RANGES = 8;               // 一个Range请求最多的区间数 (合并重叠区间后，超出时忽略Range发送整个文件)
+    static const int MAX_IOV = MAX_PIPELINE * 2 + MAX_RANGES * 2;    // 一组响应最多的iovec数 (普通响应最多两块，多区间响应每个区间两块另加结尾一块)
+    static const int MAX_CHUNK = 16384;            // 分块响应每次调用add_chunk最多追加的字节数 (也是每批生成的内容在写缓冲区中累积的上限)
 
     // 报文的请求方法 (本项目只用到GET和POST)
     enum METHOD
@@ -62,9 +80,28 @@ public:
         NO_RESOURCE,          // 没有资源
         FORBIDDEN_REQUEST,    // 客户对请求的资源没有访问权限
         FILE_REQUEST,         // 文件请求
+        NOT_MODIFIED,         // 条件请求的文件未变化 (304，只发送响应头)
+        PARTIAL_CONTENT,      // 请求文件的部分内容 (206，区间在m_ranges中)
+        RANGE_NOT_SATISFIABLE,    // 请求的区间都超出了文件范围 (416)
+        CHUNKED_RESPONSE,     // 由路由处理器分块生成的响应 (Transfer-Encoding: chunked，边生成边发送)
+        REQUEST_TOO_LARGE,    // 上传的请求体超出路由的上限 (413)
         INTERNAL_ERROR,       // 服务器内部错误
         CLOSED_CONNECTION     // 客户端已关闭连接 (未使用)
     };
+    // chunked请求体的解码状态
+    enum CHUNK_STATE
+    {
+        CHUNK_SIZE_START = 0,    // 块长度的第一个十六进制数字
+        CHUNK_SIZE,              // 块长度
+        CHUNK_EXT,               // 块扩展 (忽略)
+        CHUNK_SIZE_LF,           // 块长度行的'\n'
+        CHUNK_DATA,              // 块数据
+        CHUNK_DATA_CR,           // 块数据之后的"\r\n"
+        CHUNK_DATA_LF,
+        CHUNK_TRAILER,           // 长度为0的块之后: 尾部字段行的开头 (忽略尾部字段)
+        CHUNK_TRAILER_LINE,      // 尾部字段行中
+        CHUNK_END_LF             // 结尾空行的'\n'
+    };
     // 从状态机的状态
     enum LINE_STATUS
     {
@@ -74,11 +111,11 @@ public:
     };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_generation(0), m_read_buf(NULL), m_read_size(0), m_headers(NULL), m_upload_state(NULL), m_part_fd(-1), m_file_count(0), m_blob_count(0), m_send(NULL) {}
+    ~http_conn();
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);   // 初始化新连接 (函数内部会调用私有方法init)
+    void init(int epollfd, int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);   // 初始化新连接 (函数内部会调用私有方法init)
     void close_conn(bool real_close = true);                                                                        // 关闭http连接
     void process();                                                                                                 // 处理客户请求
     bool read_once();                                                                                               // 读取浏览器端发来的全部数据
@@ -87,74 +124,208 @@ public:
     {
         return &m_address;
     }
+    int get_sockfd()              // 获取该连接的socket
+    {
+        return m_sockfd;
+    }
     void initmysql_result(connection_pool *connPool);    // 同步线程初始化数据库读取表 (CGI使用线程池初始化数据库表)
-    int timer_flag;
-    int improv;
+    unsigned int m_generation;    // 连接代数 (每接收一个新连接+1，用于识别fd复用后的过期完成通知)
+    completion_queue *m_done;     // 工作线程处理完该连接的任务后投递完成通知的队列 (属于接收该连接的事件循环，由其在init之后设置)
+
+    // io_uring后端使用 (I/O由调用者提交，http_conn只维护缓冲区和解析状态)
+    char *get_read_tail(int *len)        // 读缓冲区中可继续接收数据的位置和长度 (读缓冲区已达上限时长度为0)
+    {
+        if (!reserve_read())
+        {
+            *len = 0;
+            return NULL;
+        }
+        *len = m_read_size - m_read_idx;
+        return m_read_buf + m_read_idx;
+    }
+    struct iovec *get_iv(int *count)     // 待发送的响应报文
+    {
+        *count = m_iv_count;
+        return m_send ? m_send->iv : NULL;
+    }
+    int read_done(int bytes);     // 接收到bytes字节后解析请求 (bytes为0时只解析读缓冲区中已有的数据。-1: 关闭连接, 0: 请求不完整继续接收, 1: 响应报文已就绪)
+    int read_done(const char *data, int bytes);    // 数据由内核写入了缓冲区环中的缓冲区: 复制到读缓冲区后解析 (返回值同上)
+    bool read_buf_empty()         // 读缓冲区中没有尚未解析的数据 (此时recv从缓冲区环中取缓冲区，空闲连接不借用读缓冲区)
+    {
+        return 0 == m_read_idx;
+    }
+    int write_done(int bytes);    // 发送了bytes字节后更新发送状态 (-1: 关闭连接, 0: 长连接发送完毕继续接收, 1: 继续发送)
+
+    bool has_buffered_request()   // 响应发送完毕后，读缓冲区中是否还有未处理的流水线请求 (有则由调用者继续处理，而不是等待可读事件)
+    {
+        return CHECK_STATE_REQUESTLINE == m_check_state && m_read_idx > m_checked_idx;
+    }
+    int timeout_type();           // 连接当前所处阶段对应的超时类型 (TIMEOUT_TYPE)
+    int get_content_length()      // 请求体长度 (用于计算请求体超时。长度未知的chunked上传按路由的上传上限计算)
+    {
+        return m_upload && m_chunked ? m_upload_limit : m_content_length;
+    }
+    header_view get_header(int id)    // 当前请求中的已知字段 (HEADER_ID)，直接指向读缓冲区，在开始解析下一个请求前有效
+    {
+        const http_header *h = m_headers ? m_headers->find(id) : NULL;
+        header_view v = {h ? m_read_buf + h->value : NULL, h ? h->value_len : 0};
+        return v;
+    }
 
+    // 供路由处理器使用
+    static void init_routes();            // 注册内置路由 (静态文件、/0等跳转页面、登录、注册、/list和/upload)
+    HTTP_CODE serve_file(const char *path);    // 以网站根目录下的文件path作为响应 (经文件缓存和内存缓存，处理条件请求和Range)
+    int get_method()                      // 请求方法 (METHOD)
+    {
+        return m_method;
+    }
+    const char *get_url()                 // 请求的URL (已去掉http://前缀，/已替换为/judge.html)
+    {
+        return m_url;
+    }
+    const char *get_root()                // 网站的根目录
+    {
+        return doc_root;
+    }
+    const char *get_body(int *len)        // 请求体 (以'\0'结尾，chunked请求体为解码后的内容)
+    {
+        *len = m_content_length;
+        return m_content_length > 0 ? m_string : "";
+    }
+    void start_chunked(route_handler *producer, const char *type, long long state);    // 开始分块响应 (200，内容由producer->next_chunk逐段生成，state为其初始进度)
+    bool add_chunk(const char *data, int len);    // 追加一段分块响应的内容 (len不超过MAX_CHUNK，失败时返回false且响应终止)
 
 private:
     void init();
+    void init_request();                         // 开始解析下一个请求 (保留并前移读缓冲区中尚未解析的数据)
+    void init_response();                        // 响应全部发送完毕后重置发送状态
+    int process_requests();                      // 依次处理读缓冲区中的请求，响应合并到同一组iovec (-1: 出错, 0: 请求不完整, 1: 响应报文已就绪)
     HTTP_CODE process_read();                    // 从m_read_buf读取，并处理请求报文
     bool process_write(HTTP_CODE ret);           // 向m_write_buf写入响应报文数据
     HTTP_CODE parse_request_line(char *text);    // 主状态机解析HTTP请求行
     HTTP_CODE parse_headers(char *text);         // 主状态机解析HTTP请求头
     HTTP_CODE parse_content(char *text);         // 主状态机解析HTTP请求体
-    HTTP_CODE do_request();                      // 生成响应报文
+    HTTP_CODE parse_chunked();                   // 解码chunked请求体 (可以分多次接收)
+    HTTP_CODE parse_upload();                    // 流式接收multipart/form-data请求体，各部分写入临时文件
+    void close_part();                           // 关闭并删除当前部分的临时文件
+    HTTP_CODE do_request();                      // 生成响应报文 (按请求方法和URL查找路由，由对应的处理器生成)
+    bool not_modified(const char *etag, int etag_len, time_t mtime);    // 按If-None-Match (优先) 或If-Modified-Since判断客户端缓存的文件是否仍然有效
+    HTTP_CODE parse_range(const char *etag);     // 处理Range和If-Range字段，解析出的区间存入m_ranges (没有Range字段、语法无效或If-Range不匹配时返回FILE_REQUEST)
+    void add_range_iv(long long first, long long len);    // 追加文件中的一段内容 (来自内存缓存、映射或sendfile)
 
+    bool reserve_read();          // 保证读缓冲区还有剩余空间 (未借用时连同请求头表一起借用，已满时换成大一级的缓冲区)
+    void release_read();          // 归还读缓冲区和请求头表
     char *get_line() { return m_read_buf + m_start_line; };    // get_line用于将指针向后偏移，指向未处理的字符 (m_start_line是已解析的字符数)
     LINE_STATUS parse_line();     // 从状态机分析一行内容
-    void unmap();
+    void release_files();         // 释放待发送的响应引用的所有文件缓存项和内存缓存项
+    void add_iv(char *base, long long len);    // 追加一段待发送数据
+    void add_file_iv(int fd, off_t off, off_t len);    // 追加一段由sendfile发送的文件内容 (从文件的off处开始)
+    void update_iv(long long bytes);    // 发送bytes字节后，更新已发送/待发送字节数和iovec
 
-    // 根据响应报文格式，生成对应8个部分 (以下函数均由do_request调用)
-    bool add_response(const char *format, ...);
+    // 根据响应报文格式，生成对应的各个部分 (以下函数均由process_write调用，直接复制字面量和转换整数，不经过格式化)
+    bool add_bytes(const char *data, int len);
+    bool add_str(const char *str);
+    bool add_number(long long value);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
     bool add_headers(int content_length);
-    bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_type(const char *type);
+    bool add_content_length(long long content_length);
+    bool add_general_headers();
     bool add_linger();
     bool add_blank_line();
+    bool end_headers();
+    bool add_validators(const char *etag, const char *encoding, const char *validators, bool vary);
+    void flush_write_buf(long long body_len);                // 写缓冲区中正在生成的数据交给iovec
+    bool add_canned(const canned_response &response);    // 追加一个预先生成的响应 (错误页等内容固定的响应)
+    bool fill_stream();                          // 由处理器生成分块响应的下一批内容并交给iovec
+    bool next_stream();                          // 分块响应已生成的部分发送完毕时重置发送状态，生成下一批 (全部生成完时不再有待发送数据)
 
 public:
-    static int m_epollfd;      // 内核事件表 (所以socket上的事件都被注册到同一个epoll内核事件表中，所以epoll文件描述符设置为static)
-    static int m_user_count;   // 用户数量
+    static std::atomic<int> m_user_count;   // 用户数量 (multi-reactor模式下多个线程同时增减，因此为原子变量)
+    static int m_max_requests;              // 每个长连接最多处理的请求数 (达到后在响应中告知关闭连接，0表示不限制)
+    static int m_sendfile_threshold;        // 不小于该大小的文件用sendfile发送，更小的文件mmap后随响应头一起writev (小于0表示全部使用mmap)
+    static const char *m_upload_dir;        // 上传的临时文件所在的目录 (默认/tmp，处理器rename保存时需要与目标在同一文件系统)
     MYSQL *mysql;              // MYSQL*连接句柄
     int m_state;   // 读为0, 写为1 (Reactor模式下，工作线程需要进行I/O读写数据，读线程或者写线程)
 
 private:
+    int m_epollfd;                         // 该连接所属的内核事件表 (单反应堆模式下所有连接共用一个，multi-reactor模式下为所属子反应堆的)
     int m_sockfd;                          // 该HTTP连接的socket
     sockaddr_in m_address;                 // 客户socket地址
 
-    char m_read_buf[READ_BUFFER_SIZE];     // 读缓冲区 (存储读取的请求报文数据)
+    char *m_read_buf;                      // 读缓冲区 (存储读取的请求报文数据。有数据时才从缓冲区池借用，读缓冲区为空时归还)
+    int m_read_size;                       // 读缓冲区可用容量 (比实际容量少一个字节，用于存放请求体结尾的'\0')
     int m_read_idx;                        // 标识读缓冲区中数据的最后一个字节的下一个位置 (m_read_buf当前的长度)
     int m_checked_idx;                     // 从状态机正在解析的字符在读缓冲区中的位置 
     int m_start_line;                      // 已解析的字符数 (当前正在解析的行的起始位置)
+    char m_body_next;                      // 请求体之后的第一个字节 (解析时被改写为'\0'，可能属于下一个流水线请求，开始解析下一个请求前恢复)
 
-    char m_write_buf[WRITE_BUFFER_SIZE];   // 写缓冲区 (存储发出的响应报文数据)
-    int m_write_idx;                       // 写缓冲区中待发送的字节数 (w_write_buf当前的长度)
+    buffer_chain m_write_buf;              // 写缓冲区 (存储发出的响应报文头部等数据，生成响应时借用，发送完毕后归还)
 
     CHECK_STATE m_check_state;             // 主状态机的状态
     METHOD m_method;                       // 请求方法
 
-    // 以下为解析请求报文中对应的6个变量
+    // 以下为解析请求报文中对应的变量
     char m_real_file[FILENAME_LEN];   // 客户请求的目标文件的完整路径
     char *m_url;                      // 客户请求的目标文件的文件名
     char *m_version;                  // HTTP协议版本号
-    char *m_host;                     // 主机名
-    int m_content_length;             // HTTP请求的消息体的长度
-    bool m_linger;                    // HTTP是否需要保持连接
+    bool m_http11;                    // 请求行中的协议版本为HTTP/1.1 (m_url为/时m_version所在位置会被"judge.html"覆盖，之后只能使用这个标志)
+    header_table *m_headers;          // 请求头表 (所有字段的名称和值在读缓冲区中的位置，已知字段可按HEADER_ID查找。与读缓冲区同时从缓冲区池借用和归还)
+    int m_content_length;             // HTTP请求的消息体的长度 (chunked请求体解码完毕后为解码后的长度)
+    bool m_chunked;                   // 请求体使用chunked传输编码
+    int m_chunk_state;                // chunked请求体的解码状态 (CHUNK_STATE)
+    long long m_chunk_left;           // 当前块剩余的字节数
+    int m_body_start;                 // 请求体在读缓冲区中的起始位置 (chunked请求体就地解码到此处)
+    int m_body_len;                   // 已解码的请求体长度 (上传时为读缓冲区中尚未交给multipart解析器的长度)
+    route_handler *m_upload;          // 接收上传的处理器 (不是上传时为NULL)
+    int m_upload_limit;               // 上传请求体的长度上限
+    long long m_body_left;            // 上传: Content-Length请求体中尚未接收的字节数
+    long long m_body_total;           // 上传: 已交给multipart解析器的字节数
+    // 上传的接收状态 (确定请求体交给上传处理器时从缓冲区池借用，开始解析下一个请求时归还)
+    struct upload_state
+    {
+        multipart_parser multipart;
+        char part_path[128];          // 当前部分的临时文件路径
+    };
+    upload_state *m_upload_state;
+    int m_part_fd;                    // 当前部分的临时文件 (没有时为-1)
+    long long m_part_size;
+    bool m_linger;                    // HTTP是否需要保持连接 (HTTP/1.1默认保持，HTTP/1.0默认不保持，可由Connection字段指定)
 
-    char *m_file_address;      // 读取服务器上的文件地址 (客户请求的目标文件被mmap到内存中的起始位置)
     struct stat m_file_stat;   // 目标文件的信息 (通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息)
+    file_entry *m_file;        // 目标文件的缓存项 (文件内容被mmap到内存中，或保持打开用于sendfile)
+    int m_file_count;          // 待发送的响应引用的缓存项数 (缓存项在m_send->files中，发送完毕后统一释放)
+    blob *m_blob;              // 目标文件的内存缓存项 (命中或新缓存时有效，响应头和文件内容都直接从中发送)
+    int m_blob_count;
+    int m_range_count;
 
-    // 我们将采用writev来执行写操作，所以定义如下两个成员，其中m_iv_count表示被写内存块的数量
-    struct iovec m_iv[2];       
+    // 一组响应的发送状态 (解析请求时从缓冲区池借用，响应全部发送完毕后归还，等待请求的长连接不占用)
+    // 我们将采用writev来执行写操作，其中m_iv_count表示被写内存块的数量 (普通响应最多两块: 写缓冲区中的响应头和文件；多区间响应每个区间另有一段分隔头)
+    // 用sendfile发送的文件也占一块: iov_base为NULL，iov_len为剩余长度，文件描述符和下一次发送的偏移分别记录在iv_fd和iv_off中
+    struct send_state
+    {
+        struct iovec iv[MAX_IOV];
+        int iv_fd[MAX_IOV];                // 各块对应的文件描述符 (内存块为-1)
+        off_t iv_off[MAX_IOV];
+        file_entry *files[MAX_PIPELINE];   // 待发送的响应引用的所有缓存项
+        blob *blobs[MAX_PIPELINE];
+        long long ranges[MAX_RANGES][2];   // Range请求的区间 (首尾字节的偏移，已排序并合并重叠或相邻的区间)
+    };
+    send_state *m_send;
     int m_iv_count;
+    int m_response_count;      // 已生成但尚未发送完毕的响应数
+    bool m_keep_alive;         // 响应发送完毕后是否保持连接 (取最后一个响应的m_linger)
+    route_handler *m_stream;   // 正在生成分块响应的处理器 (内容全部生成后为NULL)
+    long long m_stream_state;  // 处理器的进度
+    const char *m_stream_type; // 分块响应的Content-Type
+    bool m_stream_chunked;     // 使用chunked编码 (HTTP/1.0客户端直接发送内容，以关闭连接表示结束)
+    bool m_stream_error;       // add_chunk失败
 
-    int cgi;                   // 是否启用的POST
     char *m_string;            // 存储请求体数据
-    int bytes_to_send;         // 剩余发送字节数
-    int bytes_have_send;       // 已发送字节数
+    long long bytes_to_send;   // 剩余发送字节数
+    long long bytes_have_send; // 已发送字节数
+    int m_request_count;       // 该连接上已生成响应的请求数 (大于0且读缓冲区为空时，表示长连接正在等待下一个请求)
     char *doc_root;   // 网站的根目录
 
     map<string, string> m_users;
@@ -0,0 +1,86 @@
+#include "http_date.h"
+
+#include <string.h>
+
+static const char days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static void put2(char *p, int v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+// 不经过strftime (与locale无关，也避免逐个解析格式串)
+void http_date::format(time_t t, char *buf)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    memcpy(buf, days[tm.tm_wday], 3);
+    buf[3] = ',';
+    buf[4] = ' ';
+    put2(buf + 5, tm.tm_mday);
+    buf[7] = ' ';
+    memcpy(buf + 8, months[tm.tm_mon], 3);
+    buf[11] = ' ';
+    int year = tm.tm_year + 1900;
+    put2(buf + 12, year / 100 % 100);
+    put2(buf + 14, year % 100);
+    buf[16] = ' ';
+    put2(buf + 17, tm.tm_hour);
+    buf[19] = ':';
+    put2(buf + 20, tm.tm_min);
+    buf[22] = ':';
+    put2(buf + 23, tm.tm_sec);
+    memcpy(buf + 25, " GMT", 4);
+}
+
+// 每个事件循环线程和工作线程各自缓存 (CLOCK_REALTIME_COARSE经vDSO读取，每秒只格式化一次，线程之间不需要同步)
+const char *http_date::now()
+{
+    static __thread time_t cached_sec = -1;
+    static __thread char cached[LEN + 1];
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != cached_sec)
+    {
+        format(ts.tv_sec, cached);
+        cached[LEN] = '\0';
+        cached_sec = ts.tv_sec;
+    }
+    return cached;
+}
+
+bool http_date::parse(const char *str, int len, time_t *t)
+{
+    // 'd'的位置必须是数字，其余位置 (星期、月份除外) 必须与模板一致
+    static const char pattern[] = "www, dd mmm dddd dd:dd:dd GMT";
+    if (len != LEN)
+        return false;
+    for (int i = 0; i < LEN; ++i)
+    {
+        if ('d' == pattern[i] ? (str[i] < '0' || str[i] > '9') : ('w' != pattern[i] && 'm' != pattern[i] && str[i] != pattern[i]))
+            return false;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; ++i)
+    {
+        if (memcmp(str + 8, months[i], 3) == 0)
+            tm.tm_mon = i;
+    }
+    if (tm.tm_mon < 0)
+        return false;
+    tm.tm_mday = (str[5] - '0') * 10 + (str[6] - '0');
+    tm.tm_year = (str[12] - '0') * 1000 + (str[13] - '0') * 100 + (str[14] - '0') * 10 + (str[15] - '0') - 1900;
+    tm.tm_hour = (str[17] - '0') * 10 + (str[18] - '0');
+    tm.tm_min = (str[20] - '0') * 10 + (str[21] - '0');
+    tm.tm_sec = (str[23] - '0') * 10 + (str[24] - '0');
+    if (tm.tm_mday < 1 || tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+        return false;
+    *t = timegm(&tm);
+    return true;
+}
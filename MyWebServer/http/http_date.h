@@ -0,0 +1,17 @@
+#ifndef HTTP_DATE_H
+#define HTTP_DATE_H
+
+#include <time.h>
+
+// HTTP日期 (IMF-fixdate，如"Sun, 06 Nov 1994 08:49:37 GMT"，固定29个字符)
+class http_date
+{
+public:
+    static const int LEN = 29;
+
+    static const char *now();                                  // 当前时间 (每个线程缓存一份，秒数变化时才重新格式化，用于Date字段)
+    static void format(time_t t, char *buf);                   // 格式化为LEN个字符 (不写'\0')
+    static bool parse(const char *str, int len, time_t *t);    // 解析IMF-fixdate (用于If-Modified-Since、If-Range)
+};
+
+#endif
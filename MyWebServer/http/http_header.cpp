@@ -0,0 +1,56 @@
+#include "http_header.h"
+#include "http_scan.h"
+
+// 哈希值相同的case标签无法通过编译，新增字段后若出现冲突，需要调整header_hash
+#define HEADER_CASE(id, name)                                                          \
+    case header_hash(name, sizeof(name) - 1):                                          \
+        return (sizeof(name) - 1 == len && http_scan::iequals(p, name, len)) ? id : HDR_UNKNOWN;
+
+int header_table::lookup(const char *p, int len)
+{
+    if (len < MIN_NAME_LEN || len > MAX_NAME_LEN)
+        return HDR_UNKNOWN;
+
+    switch (header_hash(p, len))
+    {
+        HEADER_CASE(HDR_HOST, "host")
+        HEADER_CASE(HDR_CONNECTION, "connection")
+        HEADER_CASE(HDR_CONTENT_LENGTH, "content-length")
+        HEADER_CASE(HDR_CONTENT_TYPE, "content-type")
+        HEADER_CASE(HDR_TRANSFER_ENCODING, "transfer-encoding")
+        HEADER_CASE(HDR_EXPECT, "expect")
+        HEADER_CASE(HDR_ACCEPT, "accept")
+        HEADER_CASE(HDR_ACCEPT_ENCODING, "accept-encoding")
+        HEADER_CASE(HDR_ACCEPT_LANGUAGE, "accept-language")
+        HEADER_CASE(HDR_RANGE, "range")
+        HEADER_CASE(HDR_IF_RANGE, "if-range")
+        HEADER_CASE(HDR_IF_MATCH, "if-match")
+        HEADER_CASE(HDR_IF_NONE_MATCH, "if-none-match")
+        HEADER_CASE(HDR_IF_MODIFIED_SINCE, "if-modified-since")
+        HEADER_CASE(HDR_IF_UNMODIFIED_SINCE, "if-unmodified-since")
+        HEADER_CASE(HDR_COOKIE, "cookie")
+        HEADER_CASE(HDR_USER_AGENT, "user-agent")
+        HEADER_CASE(HDR_REFERER, "referer")
+        HEADER_CASE(HDR_ORIGIN, "origin")
+        HEADER_CASE(HDR_UPGRADE, "upgrade")
+        HEADER_CASE(HDR_CACHE_CONTROL, "cache-control")
+        HEADER_CASE(HDR_AUTHORIZATION, "authorization")
+    }
+    return HDR_UNKNOWN;
+}
+
+bool header_table::add(int id, int name, int name_len, int value, int value_len)
+{
+    if (m_count == MAX_HEADERS)
+        return false;
+
+    http_header &h = m_headers[m_count++];
+    h.id = id;
+    h.name = name;
+    h.name_len = name_len;
+    h.value = value;
+    h.value_len = value_len;
+    if (id != HDR_UNKNOWN && !m_index[id])
+        m_index[id] = m_count;
+    return true;
+}
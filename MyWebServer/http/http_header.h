@@ -0,0 +1,96 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <string.h>
+
+// 已知请求头字段 (字段名经完美哈希映射到此枚举，其余字段为HDR_UNKNOWN)
+enum HEADER_ID
+{
+    HDR_UNKNOWN = 0,
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_TRANSFER_ENCODING,
+    HDR_EXPECT,
+    HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_IF_MATCH,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_UNMODIFIED_SINCE,
+    HDR_COOKIE,
+    HDR_USER_AGENT,
+    HDR_REFERER,
+    HDR_ORIGIN,
+    HDR_UPGRADE,
+    HDR_CACHE_CONTROL,
+    HDR_AUTHORIZATION,
+    HDR_NUM
+};
+
+// 字段名的完美哈希 (由长度、第3个字符和倒数第2个字符计算，字母按位或0x20转为小写。
+// 已知字段名的哈希值两两不同，由header_table::lookup中switch的case标签在编译期保证)
+constexpr unsigned header_hash(const char *name, int len)
+{
+    return (len + 2 * ((unsigned char)name[2] | 0x20) + 9 * ((unsigned char)name[len - 2] | 0x20)) & 63;
+}
+
+// 指向读缓冲区的一段字符串 (不复制，也不以'\0'结尾；字段不存在时str为NULL、len为0)
+struct header_view
+{
+    const char *str;
+    int len;
+};
+
+// 解析出的一个请求头 (记录相对读缓冲区起始位置的偏移，读缓冲区扩大换址后仍然有效)
+struct http_header
+{
+    int id;           // HEADER_ID
+    int name;         // 字段名的偏移
+    int name_len;
+    int value;        // 字段值的偏移 (已去掉首尾空白)
+    int value_len;
+};
+
+// 请求头表 (按出现顺序保存所有字段，已知字段另建索引，按HEADER_ID直接查找)
+class header_table
+{
+public:
+    static const int MAX_HEADERS = 64;     // 一个请求最多的字段数 (超出时按错误请求处理)
+    static const int MIN_NAME_LEN = 4;     // 已知字段名的最短长度 (host)
+    static const int MAX_NAME_LEN = 19;    // 已知字段名的最长长度 (if-unmodified-since)
+
+    header_table() { clear(); }
+
+    static int lookup(const char *name, int len);    // 字段名对应的HEADER_ID (不区分大小写)
+
+    void clear()
+    {
+        m_count = 0;
+        memset(m_index, 0, sizeof(m_index));
+    }
+    bool add(int id, int name, int name_len, int value, int value_len);    // 追加一个字段 (字段数已达上限时返回false)
+    const http_header *find(int id) const         // 已知字段 (出现多次时为第一次出现的)，不存在时返回NULL
+    {
+        return m_index[id] ? &m_headers[m_index[id] - 1] : NULL;
+    }
+    int count() const
+    {
+        return m_count;
+    }
+    const http_header &at(int i) const
+    {
+        return m_headers[i];
+    }
+
+private:
+    http_header m_headers[MAX_HEADERS];
+    int m_count;
+    unsigned char m_index[HDR_NUM];     // 已知字段在m_headers中的位置+1 (0表示不存在)
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "http_router.h"
+
+#include <string.h>
+
+router::router()
+{
+    m_nodes.resize(1);
+    memset(m_nodes[0].handler, 0, sizeof(m_nodes[0].handler));
+}
+
+router *router::get_instance()
+{
+    static router instance;
+    return &instance;
+}
+
+int router::child(int n, char c) const
+{
+    const std::vector<int> &children = m_nodes[n].children;
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+        if (m_nodes[children[i]].label[0] == c)
+            return children[i];
+    }
+    return -1;
+}
+
+void router::split(int n, int at)
+{
+    // 先扩容再取引用 (push_back可能使已有元素换址)
+    m_nodes.push_back(node());
+    int tail = m_nodes.size() - 1;
+    node &parent = m_nodes[n];
+    node &rest = m_nodes[tail];
+
+    rest.label = parent.label.substr(at);
+    rest.children.swap(parent.children);
+    memcpy(rest.handler, parent.handler, sizeof(parent.handler));
+
+    parent.label.resize(at);
+    parent.children.push_back(tail);
+    memset(parent.handler, 0, sizeof(parent.handler));
+}
+
+bool router::add(int method, const char *path, int match, route_handler *handler)
+{
+    if (method < 0 || method >= METHOD_NUM || match < 0 || match >= MATCH_NUM || !handler || !path || '/' != path[0])
+        return false;
+
+    // 沿已有的边前进，边上只有部分字节相同时拆开，剩余的路径作为新的叶结点
+    int n = 0;
+    const char *p = path;
+    while (*p)
+    {
+        int c = child(n, *p);
+        if (c < 0)
+        {
+            m_nodes.push_back(node());
+            c = m_nodes.size() - 1;
+            m_nodes[c].label = p;
+            memset(m_nodes[c].handler, 0, sizeof(m_nodes[c].handler));
+            m_nodes[n].children.push_back(c);
+            n = c;
+            break;
+        }
+
+        const std::string &label = m_nodes[c].label;
+        size_t common = 1;
+        while (common < label.size() && p[common] == label[common])
+            ++common;
+        if (common < label.size())
+            split(c, common);
+        n = c;
+        p += common;
+    }
+
+    if (m_nodes[n].handler[match][method])
+        return false;
+    m_nodes[n].handler[match][method] = handler;
+    return true;
+}
+
+route_handler *router::find(int method, const char *path, int len) const
+{
+    if (method < 0 || method >= METHOD_NUM)
+        return NULL;
+
+    // 经过的每个结点都是路径的前缀，记录其中最长的前缀路由
+    int n = 0;
+    int i = 0;
+    route_handler *best = m_nodes[0].handler[PREFIX][method];
+    while (i < len)
+    {
+        int c = child(n, path[i]);
+        if (c < 0)
+            break;
+        const std::string &label = m_nodes[c].label;
+        if ((int)label.size() > len - i || memcmp(label.data(), path + i, label.size()) != 0)
+            break;
+        n = c;
+        i += label.size();
+        if (m_nodes[n].handler[PREFIX][method])
+            best = m_nodes[n].handler[PREFIX][method];
+    }
+
+    if (i == len && m_nodes[n].handler[EXACT][method])
+        return m_nodes[n].handler[EXACT][method];
+    return best;
+}
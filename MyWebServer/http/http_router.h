@@ -0,0 +1,83 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+#include <string>
+#include <vector>
+
+class http_conn;
+
+// 上传请求体中接收完毕的一个部分 (内容已写入临时文件。回调返回后临时文件即被关闭并删除，需要保留时在回调中rename到其他位置)
+struct upload_part
+{
+    const char *name;        // 表单字段名
+    const char *filename;    // 文件名 (普通字段为空串。由客户端提供，保存前需要检查)
+    const char *type;        // Content-Type (没有时为空串)
+    const char *path;        // 临时文件的路径
+    int fd;                  // 临时文件的描述符 (可以用pread读取内容)
+    long long size;          // 内容的长度
+};
+
+// 路由处理器 (每条路由注册一个实例，由所有连接共用，handle可能被多个工作线程同时调用)
+class route_handler
+{
+public:
+    virtual ~route_handler() {}
+    virtual int handle(http_conn *conn) = 0;    // 处理当前请求，返回http_conn::HTTP_CODE
+
+    // 分块响应: handle中调用conn->start_chunked后返回http_conn::CHUNKED_RESPONSE，之后每当已生成的内容发送完毕就调用一次，
+    // 用conn->add_chunk追加下一部分内容，返回false表示内容已全部生成。此时请求报文可能已被覆盖，处理器的进度只能保存在state中
+    virtual bool next_chunk(http_conn * /*conn*/, long long * /*state*/)
+    {
+        return false;
+    }
+
+    // 上传: 返回该路由接受的multipart/form-data请求体的长度上限 (字节)。大于0时这类请求体不在读缓冲区中完整缓存，
+    // 而是边接收边把各部分写入临时文件，每个部分接收完毕时调用on_part (返回false时终止上传)，整个请求体接收完毕后再调用handle
+    virtual long long upload_limit()
+    {
+        return 0;
+    }
+    virtual bool on_part(http_conn * /*conn*/, const upload_part & /*part*/)
+    {
+        return true;
+    }
+};
+
+// 路由表 (请求方法 + URL路径 -> 处理器。路径存放在基数树中，启动时注册，之后只读；
+// 查找时从根结点沿边逐段比较，耗时与路径长度成正比，不分配内存，也不需要加锁)
+class router
+{
+public:
+    static const int METHOD_NUM = 16;    // 请求方法的上限 (http_conn::METHOD)
+
+    enum MATCH
+    {
+        EXACT = 0,    // 路径完全相同
+        PREFIX,       // 路径以注册的前缀开头 (多个前缀匹配时最长的优先)
+        MATCH_NUM
+    };
+
+    // 局部静态变量 (单例模式)
+    static router *get_instance();
+
+    bool add(int method, const char *path, int match, route_handler *handler);    // 注册路由 (处理器在进程退出前一直有效。同一方法、路径和匹配方式已注册时不覆盖，返回false)
+    route_handler *find(int method, const char *path, int len) const;            // 完全匹配优先，其次最长前缀，没有匹配的路由时返回NULL
+
+private:
+    router();
+
+    // 基数树的结点 (从根到该结点各边上的字节连起来即该结点对应的路径)
+    struct node
+    {
+        std::string label;              // 父结点到该结点的边上的字节
+        std::vector<int> children;      // 子结点在m_nodes中的下标 (各子结点的label首字节互不相同)
+        route_handler *handler[MATCH_NUM][METHOD_NUM];
+    };
+
+    int child(int n, char c) const;    // 结点n的label以c开头的子结点 (没有时返回-1)
+    void split(int n, int at);         // 把结点n的边在第at个字节处拆开 (n只保留前at个字节，其余字节连同子结点和处理器移到新的子结点中)
+
+    std::vector<node> m_nodes;         // m_nodes[0]为根结点 (空路径)
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "http_scan.h"
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86
+#endif
+
+// 逐字节查找a或b
+static const char *find2_scalar(const char *p, const char *end, char a, char b)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == a || *p == b)
+            return p;
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+// SSE4.2: pcmpestri一次在16个字节中查找字符集合{a, b}中的任意字符，返回第一个匹配的位置
+__attribute__((target("sse4.2")))
+static const char *find2_sse42(const char *p, const char *end, char a, char b)
+{
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return p + idx;
+    }
+    return find2_scalar(p, end, a, b);    // 不足16字节的尾部逐字节处理 (不越过end读取)
+}
+
+// AVX2: 一次比较32个字节，两个字符的比较结果按位或后取掩码，最低位的1即第一个匹配的位置
+__attribute__((target("avx2")))
+static const char *find2_avx2(const char *p, const char *end, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return find2_sse42(p, end, a, b);
+}
+#endif
+
+// 按CPU特性选择最快的实现
+static int detect_level()
+{
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();    // 静态初始化阶段调用__builtin_cpu_supports之前需要先初始化
+    if (__builtin_cpu_supports("avx2"))
+        return http_scan::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return http_scan::SSE42;
+#endif
+    return http_scan::SCALAR;
+}
+
+static const char *(*const find2_impl[http_scan::LEVEL_NUM])(const char *, const char *, char, char) = {
+    find2_scalar,
+#ifdef HTTP_SCAN_X86
+    find2_sse42,
+    find2_avx2,
+#else
+    find2_scalar,
+    find2_scalar,
+#endif
+};
+
+int http_scan::m_level = detect_level();
+http_scan::find2_func http_scan::m_find2 = find2_impl[http_scan::m_level];
+
+bool http_scan::select(int level)
+{
+    if (level < 0 || level > detect_level())
+        return false;
+    m_level = level;
+    m_find2 = find2_impl[level];
+    return true;
+}
+
+const char *http_scan::name(int level)
+{
+    static const char *names[LEVEL_NUM] = {"scalar", "sse4.2", "avx2"};
+    return level >= 0 && level < LEVEL_NUM ? names[level] : "unknown";
+}
+
+// 不区分大小写比较 (字段名中的字母、数字和'-'与0x20按位或后，大写字母变为小写，其余字符不变。按16/8/4字节分块比较，块不足时与前一块重叠，只读取[p, p+len)内的字节)
+bool http_scan::iequals(const char *p, const char *lower, int len)
+{
+#ifdef HTTP_SCAN_X86
+    if (len >= 16)
+    {
+        const __m128i bit = _mm_set1_epi8(0x20);
+        for (int i = 0;; i += 16)
+        {
+            if (i > len - 16)
+                i = len - 16;
+            __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), bit);
+            __m128i w = _mm_loadu_si128((const __m128i *)(lower + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, w)) != 0xffff)
+                return false;
+            if (i == len - 16)
+                return true;
+        }
+    }
+#endif
+    if (len >= 8)
+    {
+        uint64_t a, b, c, d;
+        memcpy(&a, p, 8);
+        memcpy(&b, lower, 8);
+        memcpy(&c, p + len - 8, 8);
+        memcpy(&d, lower + len - 8, 8);
+        const uint64_t bit = 0x2020202020202020ULL;
+        return (a | bit) == b && (c | bit) == d;
+    }
+    if (len >= 4)
+    {
+        uint32_t a, b, c, d;
+        memcpy(&a, p, 4);
+        memcpy(&b, lower, 4);
+        memcpy(&c, p + len - 4, 4);
+        memcpy(&d, lower + len - 4, 4);
+        return (a | 0x20202020U) == b && (c | 0x20202020U) == d;
+    }
+    for (int i = 0; i < len; ++i)
+    {
+        if ((p[i] | 0x20) != lower[i])
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+// 请求报文扫描内核 (启动时按CPU特性选择AVX2、SSE4.2或逐字节实现，一次比较32/16个字节，用于定位行结束符和字段名后的':')
+class http_scan
+{
+public:
+    enum LEVEL
+    {
+        SCALAR = 0,    // 逐字节 (非x86平台或CPU不支持SSE4.2)
+        SSE42,         // 每次16字节 (pcmpestri)
+        AVX2,          // 每次32字节
+        LEVEL_NUM
+    };
+
+    // 在[p, end)中查找第一个'\r'或'\n'，找不到返回end
+    static const char *find_eol(const char *p, const char *end)
+    {
+        return m_find2(p, end, '\r', '\n');
+    }
+    // 在[p, end)中查找第一个字符c，找不到返回end
+    static const char *find_char(const char *p, const char *end, char c)
+    {
+        return m_find2(p, end, c, c);
+    }
+
+    // 不区分大小写比较len个字节 (lower为小写的字段名，只含字母、数字和'-')
+    static bool iequals(const char *p, const char *lower, int len);
+
+    static int level() { return m_level; }   // 当前使用的实现
+    static bool select(int level);           // 指定实现 (CPU不支持时返回false，供测试和性能对比使用)
+    static const char *name(int level);
+
+private:
+    typedef const char *(*find2_func)(const char *, const char *, char, char);
+
+    static int m_level;
+    static find2_func m_find2;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "multipart.h"
+
+#include <string.h>
+#include <strings.h>
+
+static bool is_space(char c)
+{
+    return ' ' == c || '\t' == c;
+}
+
+// 复制一段字符串到定长缓冲区 (放不下时返回false)
+static bool copy_value(char *dst, int size, const char *src, int len)
+{
+    if (len >= size)
+        return false;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return true;
+}
+
+bool multipart_parser::init(const char *content_type, int len)
+{
+    static const char form[] = "multipart/form-data";
+    const int form_len = sizeof(form) - 1;
+    if (!content_type || len < form_len || strncasecmp(content_type, form, form_len) != 0)
+        return false;
+
+    // 在参数中查找boundary (值可以带引号)
+    const char *p = content_type + form_len, *end = content_type + len;
+    while (p < end)
+    {
+        while (p < end && (is_space(*p) || ';' == *p))
+            ++p;
+        const char *key = p;
+        while (p < end && '=' != *p && ';' != *p)
+            ++p;
+        if (p == end || ';' == *p)
+            continue;
+        int key_len = p - key;
+        const char *value = ++p;
+        const char *value_end;
+        if (p < end && '"' == *p)
+        {
+            value = ++p;
+            while (p < end && '"' != *p)
+                ++p;
+            value_end = p;
+            if (p < end)
+                ++p;
+        }
+        else
+        {
+            while (p < end && ';' != *p && !is_space(*p))
+                ++p;
+            value_end = p;
+        }
+
+        if (8 == key_len && strncasecmp(key, "boundary", 8) == 0)
+        {
+            int n = value_end - value;
+            if (n < 1 || n > MAX_BOUNDARY)
+                return false;
+            memcpy(m_delim, "\r\n--", 4);
+            memcpy(m_delim + 4, value, n);
+            m_delim_len = 4 + n;
+            m_state = START;
+            m_name[0] = m_filename[0] = m_type[0] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *multipart_parser::find_delimiter(const char *p, const char *end, const char **hold)
+{
+    const char *q = p;
+    while (q < end && (q = (const char *)memchr(q, '\r', end - q)))
+    {
+        int n = end - q;
+        if (n >= m_delim_len)
+        {
+            if (memcmp(q, m_delim, m_delim_len) == 0)
+                return q;
+        }
+        else if (memcmp(q, m_delim, n) == 0)
+        {
+            *hold = q;    // 可能是被截断的分隔符，留到下一次
+            return NULL;
+        }
+        ++q;
+    }
+    *hold = end;
+    return NULL;
+}
+
+// 解析部分的头部 ([p, end)为各字段行，每行以"\r\n"结尾)，只关心Content-Disposition和Content-Type
+bool multipart_parser::parse_header(const char *p, const char *end)
+{
+    m_name[0] = m_filename[0] = m_type[0] = '\0';
+    bool has_name = false;
+    while (p < end)
+    {
+        const char *eol = (const char *)memmem(p, end - p, "\r\n", 2);
+        if (!eol)
+            return false;
+        const char *colon = (const char *)memchr(p, ':', eol - p);
+        if (!colon)
+            return false;
+        int name_len = colon - p;
+        const char *v = colon + 1;
+        while (v < eol && is_space(*v))
+            ++v;
+
+        if (12 == name_len && strncasecmp(p, "content-type", 12) == 0)
+        {
+            const char *v_end = eol;
+            while (v_end > v && is_space(v_end[-1]))
+                --v_end;
+            if (!copy_value(m_type, MAX_TYPE, v, v_end - v))
+                return false;
+        }
+        else if (19 == name_len && strncasecmp(p, "content-disposition", 19) == 0)
+        {
+            if (eol - v < 9 || strncasecmp(v, "form-data", 9) != 0)
+                return false;
+            // 参数: name="x"; filename="y" (带引号的值中可以有\"转义)
+            const char *q = v + 9;
+            while (q < eol)
+            {
+                while (q < eol && (is_space(*q) || ';' == *q))
+                    ++q;
+                const char *key = q;
+                while (q < eol && '=' != *q && ';' != *q)
+                    ++q;
+                if (q == eol || ';' == *q)
+                    continue;
+                int key_len = q - key;
+                ++q;
+
+                char value[MAX_FILENAME];
+                int n = 0;
+                if (q < eol && '"' == *q)
+                {
+                    for (++q; q < eol && '"' != *q; ++q)
+                    {
+                        if ('\\' == *q && q + 1 < eol)
+                            ++q;
+                        if (n == MAX_FILENAME - 1)
+                            return false;
+                        value[n++] = *q;
+                    }
+                    if (q == eol)
+                        return false;
+                    ++q;
+                }
+                else
+                {
+                    for (; q < eol && ';' != *q && !is_space(*q); ++q)
+                    {
+                        if (n == MAX_FILENAME - 1)
+                            return false;
+                        value[n++] = *q;
+                    }
+                }
+
+                if (4 == key_len && strncasecmp(key, "name", 4) == 0)
+                {
+                    if (!copy_value(m_name, MAX_NAME, value, n))
+                        return false;
+                    has_name = true;
+                }
+                else if (8 == key_len && strncasecmp(key, "filename", 8) == 0)
+                {
+                    if (!copy_value(m_filename, MAX_FILENAME, value, n))
+                        return false;
+                }
+            }
+        }
+        p = eol + 2;
+    }
+    return has_name;
+}
+
+int multipart_parser::next(const char **p, const char *end, bool last, const char **data, int *len)
+{
+    while (true)
+    {
+        int avail = end - *p;
+        switch (m_state)
+        {
+        case START:
+        {
+            // 请求体以"--boundary"开头
+            int n = m_delim_len - 2;
+            if (avail < n && memcmp(*p, m_delim + 2, avail) == 0)
+                return last ? MP_ERROR : MP_MORE;
+            if (avail >= n && memcmp(*p, m_delim + 2, n) == 0)
+            {
+                *p += n;
+                m_state = BOUNDARY_END;
+            }
+            else
+                m_state = PREAMBLE;
+            break;
+        }
+        case PREAMBLE:
+        {
+            const char *hold;
+            const char *q = find_delimiter(*p, end, &hold);
+            if (!q)
+            {
+                *p = hold;
+                return last ? MP_ERROR : MP_MORE;
+            }
+            *p = q + m_delim_len;
+            m_state = BOUNDARY_END;
+            break;
+        }
+        case BOUNDARY_END:
+            if (avail < 2)
+                return last ? MP_ERROR : MP_MORE;
+            if ('-' == (*p)[0] && '-' == (*p)[1])
+            {
+                *p += 2;
+                m_state = EPILOGUE;
+            }
+            else if (is_space(**p))
+                ++*p;    // 分隔符之后可以有空白
+            else if ('\r' == (*p)[0] && '\n' == (*p)[1])
+            {
+                *p += 2;
+                m_state = HEADER;
+            }
+            else
+                return MP_ERROR;
+            break;
+        case HEADER:
+        {
+            // 头部以空行结束 (没有任何字段时内容紧接在分隔符行之后的空行后面)
+            const char *h;
+            if (avail >= 2 && '\r' == (*p)[0] && '\n' == (*p)[1])
+                h = *p;
+            else
+            {
+                h = (const char *)memmem(*p, avail, "\r\n\r\n", 4);
+                if (h)
+                    h += 2;
+            }
+            if (!h)
+            {
+                if (avail > MAX_HEADER)
+                    return MP_ERROR;
+                return last ? MP_ERROR : MP_MORE;
+            }
+            if (h - *p > MAX_HEADER || !parse_header(*p, h))
+                return MP_ERROR;
+            *p = h + 2;
+            m_state = BODY;
+            return MP_PART_BEGIN;
+        }
+        case BODY:
+        {
+            const char *hold;
+            const char *q = find_delimiter(*p, end, &hold);
+            if (q == *p)
+            {
+                *p += m_delim_len;
+                m_state = BOUNDARY_END;
+                return MP_PART_END;
+            }
+            const char *stop = q ? q : hold;
+            if (stop == *p)
+                return last ? MP_ERROR : MP_MORE;
+            *data = *p;
+            *len = stop - *p;
+            *p = stop;
+            return MP_DATA;
+        }
+        default:    // EPILOGUE
+            *p = end;
+            return last ? MP_DONE : MP_MORE;
+        }
+    }
+}
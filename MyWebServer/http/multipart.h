@@ -0,0 +1,56 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+// multipart/form-data请求体解析器 (增量解析，不复制部分的内容)
+// 部分的内容直接以指向输入数据的视图交出；末尾可能是分隔符开头的几个字节不会被消耗，调用者需要把它们留到下一次连同新数据一起传入
+class multipart_parser
+{
+public:
+    static const int MAX_BOUNDARY = 70;    // 分隔符的最大长度 (RFC 2046)
+    static const int MAX_HEADER = 1024;    // 一个部分的头部的最大长度 (超出时解析失败)
+    static const int MAX_NAME = 64;
+    static const int MAX_FILENAME = 256;
+    static const int MAX_TYPE = 128;
+
+    enum EVENT
+    {
+        MP_MORE = 0,      // 需要更多数据 (未消耗的数据需要再次传入)
+        MP_PART_BEGIN,    // 一个部分的头部已解析 (name、filename、type可用)
+        MP_DATA,          // 当前部分的一段内容
+        MP_PART_END,      // 当前部分结束
+        MP_DONE,          // 请求体结束
+        MP_ERROR          // 格式有误
+    };
+
+    bool init(const char *content_type, int len);    // 从Content-Type中取出分隔符 (不是multipart/form-data或没有boundary参数时返回false)
+    // 从*p开始解析[*p, end)中的数据，*p前移到已消耗的位置。last表示请求体已全部传入
+    // 返回MP_DATA时内容为[*data, *data + *len)，指向输入数据
+    int next(const char **p, const char *end, bool last, const char **data, int *len);
+
+    const char *name() const { return m_name; }            // 当前部分的字段名 (Content-Disposition的name参数)
+    const char *filename() const { return m_filename; }    // 当前部分的文件名 (普通字段为空串。由客户端提供，保存前需要检查)
+    const char *type() const { return m_type; }            // 当前部分的Content-Type (没有时为空串)
+
+private:
+    enum STATE
+    {
+        START = 0,        // 请求体开头 (第一个分隔符前面可以没有"\r\n")
+        PREAMBLE,         // 第一个分隔符之前 (忽略)
+        BOUNDARY_END,     // 分隔符之后: "--"表示结束，否则为"\r\n"
+        HEADER,           // 部分的头部
+        BODY,             // 部分的内容
+        EPILOGUE          // 结束分隔符之后 (忽略)
+    };
+
+    const char *find_delimiter(const char *p, const char *end, const char **hold);    // 查找"\r\n--boundary"，找不到时*hold为末尾可能是其开头的位置
+    bool parse_header(const char *p, const char *end);
+
+    int m_state;
+    char m_delim[4 + MAX_BOUNDARY];    // "\r\n--" + boundary
+    int m_delim_len;
+    char m_name[MAX_NAME];
+    char m_filename[MAX_FILENAME];
+    char m_type[MAX_TYPE];
+};
+
+#endif
@@ -24,7 +24,17 @@ int main(int argc, char *argv[])
                 config.sql_num,      // 数据库连接池数量
                 config.thread_num,   // 线程池内的线程数量
                 config.close_log,    // 是否关闭日志
-                config.actor_model   // 并发模型选择
+                config.actor_model,  // 并发模型选择
+                config.reactor_num,  // 子反应堆数量
+                config.io_backend,   // I/O后端选择
+                config.header_timeout,   // 请求头超时
+                config.body_timeout,     // 请求体基础超时
+                config.idle_timeout,     // 长连接空闲超时
+                config.write_timeout,    // 发送停滞超时
+                config.max_requests,     // 单连接最大请求数
+                config.sendfile_threshold,   // sendfile阈值
+                config.cache_size,           // 内存缓存容量
+                config.max_age               // Cache-Control max-age规则
                 );  
     
 
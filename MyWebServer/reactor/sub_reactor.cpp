@@ -0,0 +1,361 @@
+#include "sub_reactor.h"
+#include "../webserver.h"
+
+static __thread sub_reactor *t_reactor = NULL;   // 当前线程运行的子反应堆 (供定时器回调使用)
+
+// 构造函数
+sub_reactor::sub_reactor()
+{
+    m_listenfd = -1;
+    m_epollfd = -1;
+    m_wakefd = -1;
+    m_timerfd = -1;
+    m_stop = false;
+    m_events = NULL;
+    m_generations = NULL;
+    m_pool = NULL;
+}
+
+// 析构函数
+sub_reactor::~sub_reactor()
+{
+    if (m_listenfd >= 0)
+        close(m_listenfd);
+    if (m_epollfd >= 0)
+        close(m_epollfd);
+    if (m_wakefd >= 0)
+        close(m_wakefd);
+    delete[] m_events;
+    delete[] m_generations;
+}
+
+// 创建SO_REUSEPORT监听套接字和内核事件表
+bool sub_reactor::init(int id, int port, int opt_linger, int listen_trigmode, int conn_trigmode, const int *timeouts,
+                       http_conn *users, client_data *users_timer, char *root, string user, string passWord,
+                       string databaseName, threadpool<http_conn> *pool, connection_pool *connPool, int close_log)
+{
+    m_id = id;
+    m_LISTENTrigmode = listen_trigmode;
+    m_CONNTrigmode = conn_trigmode;
+    this->users = users;
+    this->users_timer = users_timer;
+    m_root = root;
+    m_user = user;
+    m_passWord = passWord;
+    m_databaseName = databaseName;
+    m_pool = pool;
+    m_connPool = connPool;
+    m_close_log = close_log;
+
+    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    if (m_listenfd < 0)
+        return false;
+
+    struct linger tmp = {opt_linger == 1 ? 1 : 0, 1};
+    setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+
+    // 每个子反应堆都绑定同一端口，由内核按四元组哈希把新连接分发到各个监听套接字上 (避免多线程争抢同一个accept队列)
+    int flag = 1;
+    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    if (setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) < 0)
+        return false;
+
+    struct sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(m_listenfd, (struct sockaddr *)&address, sizeof(address)) < 0)
+        return false;
+    if (listen(m_listenfd, 5) < 0)
+        return false;
+
+    m_epollfd = epoll_create(5);
+    if (m_epollfd < 0)
+        return false;
+    m_events = new epoll_event[MAX_EVENT_NUMBER];
+    m_generations = new unsigned int[MAX_EVENT_NUMBER];
+    m_owned.assign(MAX_FD, false);
+
+    m_wakefd = eventfd(0, EFD_NONBLOCK);
+    if (m_wakefd < 0)
+        return false;
+
+    utils.init(timeouts);
+    m_timerfd = utils.create_timerfd();
+    if (m_timerfd < 0)
+        return false;
+
+    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+    utils.addfd(m_epollfd, m_wakefd, false, 0);
+    utils.addfd(m_epollfd, m_timerfd, false, 0);
+    if (m_pool)
+        utils.addfd(m_epollfd, m_completion.get_fd(), false, 0);
+    return true;
+}
+
+// 创建线程，开始运行事件循环
+bool sub_reactor::start()
+{
+    return pthread_create(&m_thread, NULL, worker, this) == 0;
+}
+
+// 通知事件循环退出
+void sub_reactor::stop()
+{
+    m_stop = true;
+    uint64_t one = 1;
+    write(m_wakefd, &one, sizeof(one));
+}
+
+// 等待线程结束
+void sub_reactor::join()
+{
+    pthread_join(m_thread, NULL);
+}
+
+// 线程函数
+void *sub_reactor::worker(void *arg)
+{
+    sub_reactor *reactor = (sub_reactor *)arg;
+    t_reactor = reactor;
+    reactor->run();
+    return reactor;
+}
+
+// users和users_timer由所有子反应堆共享: 本子反应堆关闭fd之后，其他子反应堆 (或本子反应堆) 可能立即接收一个复用该fd的新连接，
+// 本轮中该fd的过期事件不能再作用于新连接。先查本线程的m_owned，确认fd仍属于本子反应堆后才读取共享数组中的代数
+bool sub_reactor::owns(int sockfd, unsigned int generation)
+{
+    return m_owned[sockfd] && users[sockfd].m_generation == generation;
+}
+
+// 定时器到期回调 (在本子反应堆的timer_handler中调用。pending只由本线程修改，为0时连接将被关闭，关闭之后不能再读取该元素)
+void sub_reactor::timeout_cb(client_data *user_data)
+{
+    if (0 == user_data->pending)
+        t_reactor->m_owned[user_data->sockfd] = false;
+    timeout_cb_func(user_data);
+}
+
+// 创建设置并插入定时器
+void sub_reactor::timer(int connfd, struct sockaddr_in client_address)
+{
+    users[connfd].init(m_epollfd, connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
+
+    users_timer[connfd].address = client_address;
+    users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].epollfd = m_epollfd;
+    util_timer *timer = &users_timer[connfd].timer_node;
+    timer->user_data = &users_timer[connfd];
+    timer->cb_func = timeout_cb;
+    timer->expire = utils.m_now + utils.m_timeout[TIMEOUT_HEADER];
+    users_timer[connfd].timeout_type = TIMEOUT_HEADER;
+    users_timer[connfd].pending = 0;
+    users_timer[connfd].expired = false;
+    users_timer[connfd].timer = timer;
+    users[connfd].m_done = m_pool ? &m_completion : NULL;
+    m_owned[connfd] = true;
+    utils.m_timer_lst.add_timer(timer);
+    utils.arm_timer();
+}
+
+// 调整定时器 (按连接当前所处阶段设置超时时间；推迟时惰性调整，只更新expire)
+void sub_reactor::adjust_timer(int sockfd)
+{
+    utils.set_timeout(&users_timer[sockfd], users[sockfd].timeout_type(), users[sockfd].get_content_length());
+}
+
+// 回收资源 (删除对应的定时器、注册事件，关闭对应文件描述符)
+void sub_reactor::deal_timer(util_timer *timer, int sockfd)
+{
+    if (!m_owned[sockfd])
+        return;   // 连接已关闭 (fd可能已属于其他子反应堆)
+    m_owned[sockfd] = false;
+    utils.m_timer_lst.del_timer(timer);   // 先摘除定时器，fd关闭后其他子反应堆可能立即复用该连接资源
+    cb_func(&users_timer[sockfd]);
+
+    LOG_INFO("reactor %d close fd %d", m_id, sockfd);
+}
+
+// 接收客户连接 (ET,LT)
+void sub_reactor::dealclientdata()
+{
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+
+    // LT模式下每次就绪只accept一个，ET模式下循环accept直到监听队列为空
+    do
+    {
+        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+        if (connfd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            break;
+        }
+        if (http_conn::m_user_count >= MAX_FD)
+        {
+            utils.show_error(connfd, "Internal server busy");
+            LOG_ERROR("%s", "Internal server busy");
+            break;
+        }
+        timer(connfd, client_address);
+    } while (1 == m_LISTENTrigmode);
+}
+
+// 处理工作线程投递的完成通知 (处理期间定时器已到期的连接在此关闭，其余连接按处理后的阶段调整定时器)
+void sub_reactor::dealwithcompletion()
+{
+    m_completion.drain(m_completions);
+    for (size_t i = 0; i < m_completions.size(); ++i)
+    {
+        const completion &c = m_completions[i];
+        if (!owns(c.sockfd, c.generation))
+            continue;   // 连接已被关闭 (或fd已被新连接复用)，丢弃过期通知
+
+        users_timer[c.sockfd].pending--;
+        if (c.timer_flag || (users_timer[c.sockfd].expired && 0 == users_timer[c.sockfd].pending))
+            deal_timer(users_timer[c.sockfd].timer, c.sockfd);
+        else if (0 == users_timer[c.sockfd].pending)
+            adjust_timer(c.sockfd);
+    }
+}
+
+// 接收客户数据 (由子反应堆线程读取，请求处理交给线程池或直接在本线程完成)
+void sub_reactor::dealwithread(int sockfd)
+{
+    util_timer *timer = users_timer[sockfd].timer;
+
+    // 定时器已到期，等工作线程的完成通知到达后关闭，不再处理新数据
+    if (users_timer[sockfd].expired)
+        return;
+
+    if (users[sockfd].read_once())
+    {
+        LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+
+        dealwithrequest(sockfd);
+    }
+    else
+    {
+        deal_timer(timer, sockfd);
+    }
+}
+
+// 处理读缓冲区中的请求 (交给线程池或直接在本线程完成)
+void sub_reactor::dealwithrequest(int sockfd)
+{
+    if (m_pool)
+    {
+        adjust_timer(sockfd);   // 放入请求队列之后连接状态由工作线程修改，需先调整
+        // 工作线程处理期间连接不能被关闭 (否则fd被复用时读缓冲区会被归还): 定时器到期时只做标记，由完成通知到达后关闭
+        users_timer[sockfd].pending++;
+        if (!m_pool->append_p(users + sockfd))
+        {
+            users_timer[sockfd].pending--;
+            LOG_ERROR("reactor %d %s", m_id, "request queue full");
+            deal_timer(users_timer[sockfd].timer, sockfd);    // 请求数据已从socket中读出，无法稍后再投递，关闭连接
+        }
+    }
+    else
+    {
+        {
+            connectionRAII mysqlcon(&users[sockfd].mysql, m_connPool);
+            users[sockfd].process();
+        }
+        adjust_timer(sockfd);
+    }
+}
+
+// 响应客户数据
+void sub_reactor::dealwithwrite(int sockfd)
+{
+    util_timer *timer = users_timer[sockfd].timer;
+
+    if (users_timer[sockfd].expired)
+        return;
+
+    if (users[sockfd].write())
+    {
+        LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+
+        if (users[sockfd].has_buffered_request())   // 读缓冲区中还有流水线请求，继续处理
+            dealwithrequest(sockfd);
+        else
+            adjust_timer(sockfd);
+    }
+    else
+    {
+        deal_timer(timer, sockfd);
+    }
+}
+
+// 事件循环 (定时任务由本子反应堆的timerfd驱动，信号由主线程的signalfd处理)
+void sub_reactor::run()
+{
+    bool timeout = false;
+    while (!m_stop)
+    {
+        int number = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, -1);
+        if (number < 0 && errno != EINTR)
+        {
+            LOG_ERROR("reactor %d %s", m_id, "epoll failure");
+            break;
+        }
+        utils.update_now();
+
+        // 先记录各连接当前的代数，处理本轮事件的过程中fd被关闭并复用时据此丢弃过期事件
+        for (int i = 0; i < number; i++)
+        {
+            int fd = m_events[i].data.fd;
+            m_generations[i] = m_owned[fd] ? users[fd].m_generation : 0;
+        }
+
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = m_events[i].data.fd;
+
+            if (sockfd == m_listenfd)
+            {
+                dealclientdata();
+            }
+            else if (sockfd == m_wakefd)
+            {
+                uint64_t count;
+                read(m_wakefd, &count, sizeof(count));
+            }
+            else if (sockfd == m_timerfd)
+            {
+                timeout = true;   // 本轮其余事件处理完之后再执行定时任务
+            }
+            else if (sockfd == m_completion.get_fd())
+            {
+                dealwithcompletion();
+            }
+            else if (!owns(sockfd, m_generations[i]))
+            {
+                continue;   // 过期事件 (连接已在本轮中被关闭)
+            }
+            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                util_timer *timer = users_timer[sockfd].timer;
+                deal_timer(timer, sockfd);
+            }
+            else if (m_events[i].events & EPOLLIN)
+            {
+                dealwithread(sockfd);
+            }
+            else if (m_events[i].events & EPOLLOUT)
+            {
+                dealwithwrite(sockfd);
+            }
+        }
+
+        if (timeout)
+        {
+            utils.timer_handler();
+            timeout = false;
+        }
+    }
+}
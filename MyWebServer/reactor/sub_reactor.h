@@ -0,0 +1,84 @@
+#ifndef SUB_REACTOR_H
+#define SUB_REACTOR_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <cassert>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <vector>
+
+#include "../threadpool/threadpool.h"
+#include "../http/http_conn.h"
+#include "../timer/lst_timer.h"
+
+// 子反应堆 (multi-reactor模式下，每个线程独占一个epoll内核事件表、一个SO_REUSEPORT监听套接字、一个定时器容器，并负责自己所接收连接的全部I/O)
+class sub_reactor
+{
+public:
+    sub_reactor();
+    ~sub_reactor();
+
+    // 创建监听套接字和内核事件表 (users和users_timer为所有子反应堆共享的数组，按fd下标划分，一个fd在任意时刻只属于一个子反应堆:
+    // 从该子反应堆accept到它关闭fd为止，只有它 (和它投递的工作线程) 访问对应的元素)
+    bool init(int id, int port, int opt_linger, int listen_trigmode, int conn_trigmode, const int *timeouts,
+              http_conn *users, client_data *users_timer, char *root, string user, string passWord,
+              string databaseName, threadpool<http_conn> *pool, connection_pool *connPool, int close_log);
+
+    bool start();   // 创建线程，开始运行事件循环
+    void stop();    // 通知事件循环退出 (可在其他线程调用)
+    void join();    // 等待线程结束
+
+private:
+    static void *worker(void *arg);   // 线程函数 (调用run执行事件循环)
+    void run();                       // 事件循环
+
+    static void timeout_cb(client_data *user_data);   // 定时器到期回调 (即将关闭时先放弃对该fd的所有权)
+    bool owns(int sockfd, unsigned int generation);   // 该fd上的连接是否仍属于本子反应堆、且未被关闭后复用
+    void timer(int connfd, struct sockaddr_in client_address);
+    void adjust_timer(int sockfd);
+    void deal_timer(util_timer *timer, int sockfd);
+    void dealclientdata();
+    void dealwithcompletion();
+    void dealwithread(int sockfd);
+    void dealwithrequest(int sockfd);
+    void dealwithwrite(int sockfd);
+
+private:
+    int m_id;               // 子反应堆编号
+    int m_listenfd;         // 监听套接字 (SO_REUSEPORT，由内核在各子反应堆之间分发新连接)
+    int m_epollfd;          // 内核事件表
+    int m_wakefd;           // eventfd，用于通知事件循环退出
+    int m_timerfd;          // 驱动本子反应堆定时器容器的timerfd
+    int m_LISTENTrigmode;   // listenfd触发模式
+    int m_CONNTrigmode;     // connfd触发模式
+    int m_close_log;        // 是否关闭日志
+    std::atomic<bool> m_stop;   // 是否退出事件循环
+    pthread_t m_thread;     // 线程id
+
+    http_conn *users;              // http_conn对象数组 (共享)
+    client_data *users_timer;      // 定时器客户数据数组 (共享)
+    Utils utils;                   // 本子反应堆私有的定时器容器和timerfd
+    epoll_event *m_events;         // epoll_wait就绪事件数组
+    unsigned int *m_generations;   // 本轮就绪事件对应连接的代数 (epoll_wait返回时记录)
+    std::vector<bool> m_owned;     // 本子反应堆当前拥有的fd (accept时置位，关闭之前清除。只由本线程读写，判断归属时不读共享数组中可能正被其他子反应堆初始化的元素)
+
+    char *m_root;                  // root文件夹路径
+    string m_user;                 // 登陆数据库用户名
+    string m_passWord;             // 登陆数据库密码
+    string m_databaseName;         // 使用数据库名
+    threadpool<http_conn> *m_pool; // 线程池 (可选，为NULL时在本线程内直接处理请求)
+    completion_queue m_completion;             // 工作线程处理完本子反应堆的连接后投递完成通知的队列 (使用线程池时)
+    std::vector<completion> m_completions;     // 每次取出的完成通知
+    connection_pool *m_connPool;   // 数据库连接池
+};
+
+#endif
@@ -0,0 +1,194 @@
+/*************************************************************
+*请求报文扫描性能对比: 逐字节查找行结束符 + strncasecmp链 (原实现) vs http_scan (逐字节/SSE4.2/AVX2)
+*对一组浏览器请求头 (Chrome风格，含Cookie) 重复解析，输出每周期处理的字节数
+*用法: ./parser_bench [轮数]
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <x86intrin.h>
+#include "../../http/http_scan.h"
+
+static const char *g_requests[] = {
+    "GET / HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; _ga_ABCDEF=GS1.1.1700000000.3.1.1700000100.0.0.0; session=3f9a1c2b7d8e4f5a6b7c8d9e0f1a2b3c\r\n"
+    "\r\n",
+
+    "GET /picture.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Referer: http://www.example.com/welcome.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; _ga_ABCDEF=GS1.1.1700000000.3.1.1700000100.0.0.0; session=3f9a1c2b7d8e4f5a6b7c8d9e0f1a2b3c\r\n"
+    "\r\n",
+
+    "POST /2CGISQL.cgi HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 28\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Origin: http://www.example.com\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+    "Referer: http://www.example.com/log.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; _ga_ABCDEF=GS1.1.1700000000.3.1.1700000100.0.0.0; session=3f9a1c2b7d8e4f5a6b7c8d9e0f1a2b3c\r\n"
+    "\r\n",
+};
+
+// 解析结果 (防止编译器把解析过程优化掉，也用于校验两种实现结果一致)
+struct result
+{
+    int lines;
+    int linger;
+    long content_length;
+    int host_len;
+};
+
+// 原实现: 逐字节查找'\r'，用strncasecmp链识别字段
+static void parse_before(char *buf, int len, result *r)
+{
+    char *p = buf, *end = buf + len;
+    char *line = p;
+    for (; p < end; ++p)
+    {
+        if (*p != '\r')
+            continue;
+        if (p + 1 >= end || p[1] != '\n')
+            break;
+        p[0] = p[1] = '\0';
+        char *text = line;
+        line = ++p + 1;
+        if (r->lines++ == 0 || text[0] == '\0')
+            continue;
+
+        if (strncasecmp(text, "Connection:", 11) == 0)
+        {
+            text += 11;
+            text += strspn(text, " \t");
+            r->linger = strcasecmp(text, "keep-alive") == 0;
+        }
+        else if (strncasecmp(text, "Content-length:", 15) == 0)
+        {
+            text += 15;
+            text += strspn(text, " \t");
+            r->content_length = atol(text);
+        }
+        else if (strncasecmp(text, "Host:", 5) == 0)
+        {
+            text += 5;
+            text += strspn(text, " \t");
+            r->host_len = strlen(text);
+        }
+    }
+}
+
+// 新实现: http_scan定位行结束符和':'，按字段名长度分派后比较
+static void parse_after(char *buf, int len, result *r)
+{
+    char *p = buf, *end = buf + len;
+    char *line = p;
+    while ((p = (char *)http_scan::find_eol(p, end)) < end)
+    {
+        if (*p != '\r' || p + 1 >= end || p[1] != '\n')
+            break;
+        p[0] = p[1] = '\0';
+        char *text = line;
+        char *line_end = p;
+        line = p += 2;
+        if (r->lines++ == 0 || text[0] == '\0')
+            continue;
+
+        char *colon = (char *)http_scan::find_char(text, line_end, ':');
+        int name_len = colon - text;
+        char *value = colon < line_end ? colon + 1 : colon;
+        value += strspn(value, " \t");
+        if (10 == name_len && http_scan::iequals(text, "connection", 10))
+            r->linger = strcasecmp(value, "keep-alive") == 0;
+        else if (14 == name_len && http_scan::iequals(text, "content-length", 14))
+            r->content_length = atol(value);
+        else if (4 == name_len && http_scan::iequals(text, "host", 4))
+            r->host_len = line_end - value;
+    }
+}
+
+// 每轮先把原始报文复制到工作缓冲区 (解析会把"\r\n"改写为"\0\0")，只统计解析部分的周期数
+static double bench(const char *name, void (*parse)(char *, int, result *), int rounds, result *r)
+{
+    const int n = sizeof(g_requests) / sizeof(g_requests[0]);
+    static char work[4096];
+    unsigned long long cycles = 0, bytes = 0;
+    memset(r, 0, sizeof(*r));
+
+    for (int i = 0; i < rounds; ++i)
+    {
+        const char *req = g_requests[i % n];
+        int len = strlen(req);
+        memcpy(work, req, len);
+        unsigned long long t0 = __rdtsc();
+        parse(work, len, r);
+        cycles += __rdtsc() - t0;
+        bytes += len;
+    }
+
+    double bpc = (double)bytes / cycles;
+    printf("%-22s %8.3f bytes/cycle  (lines %d, keep-alive %d, content-length %ld, host %d)\n",
+           name, bpc, r->lines, r->linger, r->content_length, r->host_len);
+    return bpc;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (rounds <= 0)
+        rounds = 1000000;
+
+    printf("rounds: %d, cpu best: %s\n", rounds, http_scan::name(http_scan::level()));
+
+    result base, r;
+    double before = bench("before (strncasecmp)", parse_before, rounds, &base);
+    for (int level = http_scan::SCALAR; level < http_scan::LEVEL_NUM; ++level)
+    {
+        if (!http_scan::select(level))
+            continue;
+        char name[32];
+        snprintf(name, sizeof(name), "after (%s)", http_scan::name(level));
+        double after = bench(name, parse_after, rounds, &r);
+        if (memcmp(&base, &r, sizeof(r)) != 0)
+        {
+            printf("result mismatch at level %s\n", http_scan::name(level));
+            return 1;
+        }
+        printf("%-22s %8.2fx\n", "", after / before);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*************************************************************
+*定时器容器性能对比: sort_timer_lst (升序链表) vs time_wheel (分层时间轮)
+*分别测试1k/10k/100k个定时器下添加、调整、删除、到期处理的平均耗时
+*用法: ./timer_bench [定时器数量...]
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../../timer/time_wheel.h"
+#include "../../timer/sort_timer_lst.h"
+
+// 测试用的连接资源和定时器 (与服务器的client_data、util_timer结构相同，两种容器都只依赖这些成员，不需要链接服务器的源文件)
+struct bench_data
+{
+    int id;
+};
+
+struct bench_timer
+{
+    bench_timer() : prev(NULL), next(NULL) {}
+
+    time_t expire;
+    void (*cb_func)(bench_data *);
+    bench_data *user_data;
+    bench_timer *prev;
+    bench_timer *next;
+};
+
+static int g_expired = 0;
+
+// 测试用回调函数 (只计数，不关闭连接)
+static void bench_cb(bench_data * /*user_data*/)
+{
+    ++g_expired;
+}
+
+// 单调时钟的当前毫秒数 (与服务器的定时器使用相同的时钟)
+static time_t get_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 单调时钟的当前纳秒数
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bench_timer *new_timer(time_t expire, bench_data *data)
+{
+    bench_timer *timer = new bench_timer;
+    timer->expire = expire;
+    timer->cb_func = bench_cb;
+    timer->user_data = data;
+    return timer;
+}
+
+// 模拟服务器的使用方式: 超时时间为当前时间+15秒附近，活动时推迟，关闭时删除，空闲则到期
+template <typename LIST>
+static void bench(const char *name, LIST &lst, int n)
+{
+    std::vector<bench_data> users(n);
+    std::vector<bench_timer *> timers(n);
+    time_t base = get_ms();
+    srand(n);
+
+    // 添加: 连接陆续建立，超时时间大致递增
+    long long t0 = now_ns();
+    for (int i = 0; i < n; ++i)
+    {
+        timers[i] = new_timer(base + 15000 + i % 1000, &users[i]);
+        lst.add_timer(timers[i]);
+    }
+    long long t_add = now_ns() - t0;
+
+    // 调整: 随机连接上有数据到达，超时时间推迟到最晚 (链表每次调整为O(n)，最多测10000次)
+    int adjusts = n < 10000 ? n : 10000;
+    t0 = now_ns();
+    for (int i = 0; i < adjusts; ++i)
+    {
+        bench_timer *timer = timers[rand() % n];
+        timer->expire = base + 16000 + i % 1000;
+        lst.adjust_timer(timer);
+    }
+    long long t_adjust = now_ns() - t0;
+
+    // 删除: 一半连接主动关闭
+    t0 = now_ns();
+    for (int i = 0; i < n; i += 2)
+        lst.del_timer(timers[i]);
+    long long t_del = now_ns() - t0;
+
+    // 到期: 另一半连接全部超时 (将超时时间改到过去后一次tick处理完)
+    for (int i = 1; i < n; i += 2)
+    {
+        timers[i]->expire = base - 1;
+        lst.adjust_timer(timers[i]);
+    }
+    g_expired = 0;
+    t0 = now_ns();
+    lst.tick();
+    long long t_tick = now_ns() - t0;
+
+    int half = (n + 1) / 2;
+    printf("%-16s n=%-7d add %9.1f ns/op  adjust %9.1f ns/op  del %9.1f ns/op  tick %9.1f ns/op  (expired %d)\n",
+           name, n, (double)t_add / n, (double)t_adjust / adjusts, (double)t_del / half, (double)t_tick / (n - half), g_expired);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(atoi(argv[i]));
+    if (sizes.empty())
+    {
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+    }
+
+    for (size_t i = 0; i < sizes.size(); ++i)
+    {
+        {
+            sort_timer_lst<bench_timer> lst(get_ms);
+            bench("sort_timer_lst", lst, sizes[i]);
+        }
+        {
+            time_wheel<bench_timer> wheel(get_ms);
+            bench("time_wheel", wheel, sizes[i]);
+        }
+    }
+    return 0;
+}
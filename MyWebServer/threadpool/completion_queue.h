@@ -0,0 +1,87 @@
+/*************************************************************
+*工作线程 -> 主线程的完成通知队列 (多生产者单消费者)
+*工作线程处理完任务后将结果压入队列，并通过eventfd唤醒主线程的epoll_wait
+*主线程一次性取走全部完成通知，不再忙等某个连接的处理结果
+**************************************************************/
+
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../lock/locker.h"
+
+// 一条完成通知
+struct completion
+{
+    int sockfd;               // 连接的socket文件描述符
+    unsigned int generation;  // 连接代数 (fd被关闭后复用时代数不同，用于丢弃过期的通知)
+    int timer_flag;           // 1表示I/O失败，需要主线程关闭连接并删除定时器
+};
+
+class completion_queue
+{
+public:
+    // 创建非阻塞eventfd
+    completion_queue()
+    {
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0)
+        {
+            throw std::exception();
+        }
+    }
+
+    ~completion_queue()
+    {
+        close(m_eventfd);
+    }
+
+    // 供主线程注册到epoll内核事件表
+    int get_fd()
+    {
+        return m_eventfd;
+    }
+
+    // 工作线程压入一条完成通知 (队列由空变为非空时才写eventfd，多个通知合并为一次唤醒)
+    void push(int sockfd, unsigned int generation, int timer_flag)
+    {
+        completion c;
+        c.sockfd = sockfd;
+        c.generation = generation;
+        c.timer_flag = timer_flag;
+
+        m_mutex.lock();
+        bool was_empty = m_queue.empty();
+        m_queue.push_back(c);
+        m_mutex.unlock();
+
+        if (was_empty)
+        {
+            uint64_t one = 1;
+            write(m_eventfd, &one, sizeof(one));
+        }
+    }
+
+    // 主线程取走全部完成通知 (先清空eventfd计数，再交换队列，保证之后压入的通知一定会再次唤醒主线程)
+    void drain(std::vector<completion> &out)
+    {
+        uint64_t count;
+        read(m_eventfd, &count, sizeof(count));
+
+        out.clear();
+        m_mutex.lock();
+        m_queue.swap(out);
+        m_mutex.unlock();
+    }
+
+private:
+    int m_eventfd;                    // 唤醒主线程的eventfd
+    std::vector<completion> m_queue;  // 完成通知队列
+    locker m_mutex;                   // 互斥锁 (保护完成通知队列)
+};
+
+#endif
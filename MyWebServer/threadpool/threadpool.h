@@ -7,6 +7,7 @@
 #include <pthread.h>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "completion_queue.h"
 
 template <typename T>
 class threadpool
@@ -17,6 +18,10 @@ public:
     ~threadpool();
     bool append(T *request, int state);
     bool append_p(T *request);             // 主线程将新任务插入请求队列
+    completion_queue *get_completion()     // 工作线程处理完任务后，通过该队列通知主线程 (multi-reactor模式下各子反应堆使用自己的队列)
+    {
+        return &m_completion;
+    }
 
 private:
     static void *worker(void *arg);        // 工作线程运行的函数 (调用run执行任务)
@@ -31,6 +36,7 @@ private:
     sem m_queuestat;              // 信号量 (是否有任务需要处理)
     connection_pool *m_connPool;  // 数据库连接池
     int m_actor_model;    // 模型切换
+    completion_queue m_completion;   // 主线程的完成通知队列
 };
 
 // 构造函数
@@ -132,43 +138,54 @@ void threadpool<T>::run()
 
         if (!request)
             continue;    
-        // Reactor模型
+        // Reactor模型 (处理完毕后向主线程投递完成通知，主线程无需忙等)
         if (1 == m_actor_model)    
         {
+            int sockfd = request->get_sockfd();              // 任务处理过程中连接可能被关闭，先记录下fd、代数和完成通知队列
+            unsigned int generation = request->m_generation;
+            completion_queue *done = request->m_done;
+            int timer_flag = 0;
+
             // 读工作线程
             if (0 == request->m_state)    
             {
                 if (request->read_once())   // 工作线程循环读取客户数据，直到无数据可读或对方关闭连接
                 {
-                    request->improv = 1;
                     connectionRAII mysqlcon(&request->mysql, m_connPool);   // 从数据库连接池中 获取一条数据库连接 来处理该任务对象request
                     request->process();                                     // 线程通过process函数对任务进行处理 (报文解析和响应)
                 }
                 else
                 {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+                    timer_flag = 1;
                 }
             }
             // 写工作线程
             else
             {
-                if (request->write())       // 写入响应报文
+                if (!request->write())      // 写入响应报文
                 {
-                    request->improv = 1;
+                    timer_flag = 1;
                 }
-                else              
+                else if (request->has_buffered_request())   // 读缓冲区中还有流水线请求，继续处理
                 {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+                    connectionRAII mysqlcon(&request->mysql, m_connPool);
+                    request->process();
                 }
             }
+
+            done->push(sockfd, generation, timer_flag);
         }
-        // Proactor模型 (同步I/O模拟proactor模式)
+        // Proactor模型 (同步I/O模拟proactor模式。处理完毕后同样投递完成通知: 处理期间定时器到期时，连接由事件循环收到通知后再关闭)
         else                      
         {
-            connectionRAII mysqlcon(&request->mysql, m_connPool);    
-            request->process();                                      
+            int sockfd = request->get_sockfd();
+            unsigned int generation = request->m_generation;
+            completion_queue *done = request->m_done;
+            {
+                connectionRAII mysqlcon(&request->mysql, m_connPool);    
+                request->process();                                      
+            }
+            done->push(sockfd, generation, 0);
         }
     }
 }
@@ -1,182 +1,73 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
 
-// 构造函数
-sort_timer_lst::sort_timer_lst()
+// 单调时钟的当前毫秒数
+time_t get_ms()
 {
-    head = NULL;
-    tail = NULL;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-// 析构函数 (常规销毁链表)
-sort_timer_lst::~sort_timer_lst()
+// 析构函数
+Utils::~Utils()
 {
-    util_timer *tmp = head;
-    while (tmp)
-    {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
-    }
+    if (m_timerfd >= 0)
+        close(m_timerfd);
 }
 
-// 添加定时器 (内部调用私有成员add_timer)
-void sort_timer_lst::add_timer(util_timer *timer)
+// 初始化 (设置各超时类型的超时时间)
+void Utils::init(const int *timeouts)
 {
-    if (!timer)
-    {
-        return;
-    }
-    if (!head)
-    {
-        head = tail = timer;
-        return;
-    }
-    // 如果新的定时器超时时间小于当前头部结点,直接将当前定时器结点作为头部结点
-    if (timer->expire < head->expire)  
-    {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
-    }
-    // 否则调用私有成员，调整内部结点
-    add_timer(timer, head);
+    for (int i = 0; i < TIMEOUT_TYPES; ++i)
+        m_timeout[i] = timeouts[i] * 1000;
 }
 
-// 调整定时器，任务发生变化时，调整定时器在链表中的位置
-void sort_timer_lst::adjust_timer(util_timer *timer)
+// 按连接所处阶段设置定时器
+void Utils::set_timeout(client_data *user_data, int type, int content_length)
 {
+    util_timer *timer = user_data->timer;
     if (!timer)
     {
         return;
     }
-
-    util_timer *tmp = timer->next;
-    // 被调整的定时器是链表尾结点，或定时器超时值仍然小于下一个定时器超时值，则不调整
-    if (!tmp || (timer->expire < tmp->expire))
+    // 请求头和请求体的超时从进入该阶段时开始计算，客户端逐字节发送也不能推迟
+    if (type == user_data->timeout_type && (TIMEOUT_HEADER == type || TIMEOUT_BODY == type))
     {
         return;
     }
-    // 被调整定时器是链表头结点，将定时器取出，重新插入
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        add_timer(timer, head);
-    }
-    // 被调整定时器在内部，将定时器取出，重新插入
-    else
-    {
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
-    }
-}
 
-// 删除定时器
-void sort_timer_lst::del_timer(util_timer *timer)
-{
-    if (!timer)
-    {
-        return;
-    }
+    time_t expire = m_now + m_timeout[type];
+    if (TIMEOUT_BODY == type)
+        expire += (time_t)content_length * 1000 / BODY_MIN_RATE;
 
-    // 链表中只有一个定时器，需要删除该定时器
-    if ((timer == head) && (timer == tail))
+    user_data->timeout_type = type;
+    bool earlier = expire < timer->expire;
+    timer->expire = expire;
+    if (earlier)   // 推迟的定时器由时间轮惰性调整，提前的需要立即移动结点并提前timerfd
     {
-        delete timer;
-        head = NULL;
-        tail = NULL;
-        return;
+        m_timer_lst.adjust_timer(timer);
+        arm_timer();
     }
-    // 被删除的定时器为头结点
-    if (timer == head)
-    {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
-        return;
-    }
-    // 被删除的定时器为尾结点
-    if (timer == tail)
-    {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
-        return;
-    }
-    // 被删除的定时器在链表内部，常规链表结点删除
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
 }
 
-// 定时任务处理函数
-void sort_timer_lst::tick()
+// 创建timerfd
+int Utils::create_timerfd()
 {
-    if (!head)
-    {
-        return;
-    }
-    
-    time_t cur = time(NULL);   // 获取当前时间
-    util_timer *tmp = head;
-    // 遍历定时器链表
-    while (tmp)
-    {   
-        // 链表容器为升序排列，若当前时间小于定时器的超时时间，则后面的定时器也没有到期
-        if (cur < tmp->expire)
-        {
-            break;
-        }
-
-        tmp->cb_func(tmp->user_data);  // 当前定时器到期，则调用回调函数，执行定时事件
-        head = tmp->next;              // 将处理后的定时器从链表容器中删除，并重置头结点
-        if (head)
-        {
-            head->prev = NULL;
-        }
-        delete tmp;
-        tmp = head;
-    }
-}
-
-// 用于调整链表内部结点 (私有成员，被公有成员add_timer和adjust_time调用)
-void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head)
-{
-    util_timer *prev = lst_head;
-    util_timer *tmp = prev->next;
-
-    // 遍历当前结点之后的链表，按照超时时间找到目标定时器对应的位置，常规双向链表插入操作
-    while (tmp)
-    {
-        if (timer->expire < tmp->expire)
-        {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
-        }
-        prev = tmp;
-        tmp = tmp->next;
-    }
-    // 遍历完发现，目标定时器需要放到尾结点处
-    if (!tmp)
-    {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
-    }
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_timer_armed = 0;
+    return m_timerfd;
 }
 
-// 初始化
-void Utils::init(int timeslot)
+// 屏蔽信号并创建对应的signalfd (需在创建其他线程之前调用，使所有线程都继承该信号屏蔽字)
+int Utils::create_signalfd(const int *sigs, int num)
 {
-    m_TIMESLOT = timeslot;
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int i = 0; i < num; ++i)
+        sigaddset(&mask, sigs[i]);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
 }
 
 // 对文件描述符设置非阻塞
@@ -205,15 +96,6 @@ void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     setnonblocking(fd);
 }
 
-// 信号处理函数
-void Utils::sig_handler(int sig)
-{
-    int save_errno = errno;   // 为保证函数的可重入性，保留原来的errno (可重入性表示中断后再次进入该函数，环境变量与之前相同，不会丢失数据)
-    int msg = sig;
-    send(u_pipefd[1], (char *)&msg, 1, 0);   // 工作线程将信号值从u_pipefd[1]写入，主线程从u_pipefd[0]读取 (传输字符类型，而非整型)
-    errno = save_errno;       // 将原来的errno赋值为当前的errno
-}
-
 // 设置信号函数
 void Utils::addsig(int sig, void(handler)(int), bool restart)
 {
@@ -226,11 +108,30 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);   // 执行sigaction函数
 }
 
-// 定时处理任务 (执行定时处理函数，并再次触发SIGALRM信号，重新定时)
+// 定时处理任务 (执行定时处理函数，并按最近的到期时间重新设置timerfd)
 void Utils::timer_handler()
 {
+    uint64_t expirations;
+    read(m_timerfd, &expirations, sizeof(expirations));   // 清除timerfd的可读状态
+
     m_timer_lst.tick();   // 到时，执行定时处理函数
-    alarm(m_TIMESLOT);    // 再次触发SIGALRM信号，重新定时
+    m_timer_armed = 0;
+    arm_timer();
+}
+
+// 按最近的到期时间设置timerfd (仅在需要提前时才调用timerfd_settime，推迟的定时器由下一次到期时的tick重新计算)
+void Utils::arm_timer()
+{
+    time_t next = m_timer_lst.next_expire();
+    if (next == 0 || (m_timer_armed != 0 && m_timer_armed <= next))
+        return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);   // 绝对时间，已过期则立即可读
+    m_timer_armed = next;
 }
 
 // 打印错误
@@ -240,16 +141,45 @@ void Utils::show_error(int connfd, const char *info)
     close(connfd);
 }
 
-int *Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
+std::atomic<int> Utils::u_expired[TIMEOUT_TYPES];
 
 
 class Utils;
-// 定时器回调函数 (关闭非活动连接)
+// 关闭连接 (关闭非活动连接或服务器端主动关闭连接)
 void cb_func(client_data *user_data)
 {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);   // 删除非活动连接在socket上的注册事件
     assert(user_data);
-    close(user_data->sockfd);    // 关闭文件描述符
+    epoll_ctl(user_data->epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);   // 删除非活动连接在socket上的注册事件
+    user_data->timer = NULL;     // 清空指针以标记该连接已关闭 (需在close之前，close之后该连接资源可能被复用)
     http_conn::m_user_count--;   // 减少连接数
+    close(user_data->sockfd);    // 关闭文件描述符
+}
+
+// io_uring后端的定时器回调函数 (close不会取消已提交给内核的recv，需先shutdown使其以0返回，再按常规流程关闭)
+void uring_cb_func(client_data *user_data)
+{
+    assert(user_data);
+    shutdown(user_data->sockfd, SHUT_RDWR);
+    cb_func(user_data);
+}
+
+// 定时器到期回调函数 (按超时类型计数后关闭连接)
+void timeout_cb_func(client_data *user_data)
+{
+    Utils::u_expired[user_data->timeout_type]++;
+    // 工作线程仍在读写该连接的缓冲区，此时关闭会使fd被新连接复用、缓冲区被归还。只做标记，由所属的事件循环收到最后一个完成通知后关闭
+    if (user_data->pending > 0)
+    {
+        user_data->expired = true;
+        return;
+    }
+    cb_func(user_data);
+}
+
+// io_uring后端的定时器到期回调函数
+void uring_timeout_cb_func(client_data *user_data)
+{
+    Utils::u_expired[user_data->timeout_type]++;
+    uring_cb_func(user_data);
 }
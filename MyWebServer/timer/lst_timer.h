@@ -22,17 +22,28 @@
 #include <sys/uio.h>
 
 #include <time.h>
+#include <atomic>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 #include "../log/log.h"
+#include "time_wheel.h"
 
-class util_timer;
+// 单调时钟的当前毫秒数 (定时器的到期时间均以此为基准，不受系统时间调整影响)
+time_t get_ms();
 
-// 连接资源 (用户数据结构体)
-struct client_data
+struct client_data;
+
+// 连接各阶段的超时类型
+enum TIMEOUT_TYPE
 {
-    sockaddr_in address;   // 客户端socket地址
-    int sockfd;            // socket文件描述符
-    util_timer *timer;     // 定时器
-}; 
+    TIMEOUT_HEADER = 0,   // 接收请求行和请求头 (从该阶段开始计时，期间收到数据不推迟，防御慢速攻击)
+    TIMEOUT_BODY,         // 接收请求体 (按Content-Length延长)
+    TIMEOUT_IDLE,         // 长连接发送完响应后等待下一个请求
+    TIMEOUT_WRITE,        // 发送响应 (每次有数据发出时推迟，客户端长时间不接收则超时)
+    TIMEOUT_TYPES
+};
+
+const int BODY_MIN_RATE = 8192;   // 请求体的最低接收速率 (字节/秒)，请求体超时 = 基础超时 + Content-Length / BODY_MIN_RATE
 
 // 定时器类
 class util_timer
@@ -41,7 +52,7 @@ public:
     util_timer() : prev(NULL), next(NULL) {}
 
 public:
-    time_t expire;   // 超时时间
+    time_t expire;   // 超时时间 (单调时钟毫秒数)
     
     void (* cb_func)(client_data *);  // 回调函数指针
     client_data *user_data;           // 用户数据结构体
@@ -49,34 +60,37 @@ public:
     util_timer *next;                 // 后继定时器
 };
 
-// 定时器容器类
-class sort_timer_lst
+// 连接资源 (用户数据结构体)
+struct client_data
 {
-public:
-    sort_timer_lst();
-    ~sort_timer_lst();   // 常规销毁链表
-
-    void add_timer(util_timer *timer);      // 添加定时器 (内部调用私有成员add_timer)
-    void adjust_timer(util_timer *timer);   // 调整定时器 (任务发生变化时，调整定时器在链表中的位置)
-    void del_timer(util_timer *timer);      // 删除定时器
-    void tick();                            // 定时任务处理函数
-
-private:
-    void add_timer(util_timer *timer, util_timer *lst_head);  // 用于调整链表内部结点 (私有成员，被公有成员add_timer和adjust_time调用)
-
-    util_timer *head;   // 头结点
-    util_timer *tail;   // 尾结点
-};
-
+    sockaddr_in address;   // 客户端socket地址
+    int sockfd;            // socket文件描述符
+    int epollfd;           // 该连接所属的内核事件表 (multi-reactor模式下每个子反应堆各有一个)
+    util_timer *timer;     // 定时器 (指向timer_node，为NULL表示连接已关闭)
+    util_timer timer_node; // 嵌入的定时器结点 (与连接资源一同预先分配，建立、调整、删除定时器均不再new/delete)
+    int timeout_type;      // 当前定时器对应的超时类型
+    int pending;           // 已投递给工作线程、尚未收到完成通知的任务数 (只由所属的事件循环修改)
+    bool expired;          // 定时器到期时工作线程仍在处理该连接，等任务全部完成后再关闭
+}; 
 
 // 工具类
 class Utils
 {
 public:
-    Utils() {}
-    ~Utils() {}
+    Utils() : m_timer_lst(get_ms), m_timerfd(-1), m_timer_armed(0), m_now(get_ms()) {}
+    ~Utils();
+
+    // 设置各超时类型的超时时间 (timeouts为按TIMEOUT_TYPE排列的秒数)
+    void init(const int *timeouts);
+
+    // 按连接所处阶段设置定时器 (阶段未变化的请求头、请求体超时不推迟；推迟时只更新expire，提前时调整结点位置)
+    void set_timeout(client_data *user_data, int type, int content_length);
 
-    void init(int timeslot);
+    // 创建timerfd (定时器容器中最近的到期时间到达时可读，注册到epoll后由事件循环调用timer_handler)
+    int create_timerfd();
+
+    // 屏蔽信号并创建对应的signalfd (被屏蔽的信号不再打断系统调用，改为由事件循环从signalfd中读取)
+    static int create_signalfd(const int *sigs, int num);
 
     // 对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -84,25 +98,41 @@ public:
     // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
     void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
-    // 信号处理函数
-    static void sig_handler(int sig);
-
     // 设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    // 定时处理任务，重新定时以不断触发SIGALRM信号
+    // 定时处理任务 (读取timerfd，处理到期定时器，并按最近的到期时间重新设置timerfd)
     void timer_handler();
 
+    // 若定时器容器中最近的到期时间早于timerfd当前的设置，则提前timerfd (添加或调整定时器后调用)
+    void arm_timer();
+
+    // 更新缓存的时钟 (事件循环每轮调用一次，处理本轮事件时统一使用m_now，不再逐个请求读取时钟)
+    void update_now()
+    {
+        m_now = get_ms();
+    }
+
     void show_error(int connfd, const char *info);  // 打印错误
 
 public:
-    static int *u_pipefd;         // 与主线程通信的管道 (主要用于信号处理函数内，通过该管道将信号发送给主线程，主线程对接收到的信号进行处理)
     static int u_epollfd;         // 内核事件表
-    sort_timer_lst m_timer_lst;   // 定时器容器
-    int m_TIMESLOT;               // 超时时间
+    time_wheel<util_timer, false> m_timer_lst;   // 定时器容器 (分层时间轮，刻度为1毫秒，结点嵌入在client_data中)
+    int m_timeout[TIMEOUT_TYPES]; // 各超时类型的超时时间 (毫秒)
+    int m_timerfd;                // 驱动定时器容器的timerfd
+    time_t m_timer_armed;         // timerfd当前设置的到期时间 (0表示未设置)
+    time_t m_now;                 // 本轮事件循环缓存的时钟 (单调时钟毫秒数)
+    static std::atomic<int> u_expired[TIMEOUT_TYPES];   // 各超时类型的到期次数 (所有子反应堆共享)
 };
 
-// 定时器回调函数
+// 关闭连接 (删除注册事件，关闭文件描述符，减少连接数)
 void cb_func(client_data *user_data);
 
+// io_uring后端的定时器回调函数 (先shutdown，使该连接上未完成的recv立即返回)
+void uring_cb_func(client_data *user_data);
+
+// 定时器到期回调函数 (按超时类型计数后关闭连接)
+void timeout_cb_func(client_data *user_data);
+void uring_timeout_cb_func(client_data *user_data);
+
 #endif
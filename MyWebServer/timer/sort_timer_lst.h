@@ -0,0 +1,219 @@
+/*************************************************************
+*升序链表定时器容器 (与time_wheel接口相同: add_timer/adjust_timer/del_timer/tick)
+*按到期时间升序排列的双向链表，添加和调整为O(n)，删除为O(1)，到期处理从头结点开始
+*服务器使用time_wheel，此容器保留用于性能对比 (见test_presure/timer_bench)
+*T需包含expire、cb_func、user_data、prev、next成员；结点由new创建，删除和到期后由容器delete
+**************************************************************/
+
+#ifndef SORT_TIMER_LST_H
+#define SORT_TIMER_LST_H
+
+#include <time.h>
+#include <stddef.h>
+
+template <typename T>
+class sort_timer_lst
+{
+public:
+    explicit sort_timer_lst(time_t (*clock)());   // clock返回当前时间 (与定时器的expire单位相同)
+    ~sort_timer_lst();   // 常规销毁链表
+
+    void add_timer(T *timer);      // 添加定时器 (内部调用私有成员add_timer)
+    void adjust_timer(T *timer);   // 调整定时器 (任务发生变化时，调整定时器在链表中的位置)
+    void del_timer(T *timer);      // 删除定时器
+    void tick();                   // 定时任务处理函数
+    time_t next_expire();          // 最近的到期时间 (没有定时器时返回0)
+
+private:
+    void add_timer(T *timer, T *lst_head);  // 用于调整链表内部结点 (私有成员，被公有成员add_timer和adjust_time调用)
+
+    T *head;               // 头结点
+    T *tail;               // 尾结点
+    time_t (*m_clock)();   // 时钟
+};
+
+// 构造函数
+template <typename T>
+sort_timer_lst<T>::sort_timer_lst(time_t (*clock)()) : head(NULL), tail(NULL), m_clock(clock)
+{
+}
+
+// 析构函数 (常规销毁链表)
+template <typename T>
+sort_timer_lst<T>::~sort_timer_lst()
+{
+    T *tmp = head;
+    while (tmp)
+    {
+        head = tmp->next;
+        delete tmp;
+        tmp = head;
+    }
+}
+
+// 添加定时器 (内部调用私有成员add_timer)
+template <typename T>
+void sort_timer_lst<T>::add_timer(T *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    if (!head)
+    {
+        head = tail = timer;
+        return;
+    }
+    // 如果新的定时器超时时间小于当前头部结点,直接将当前定时器结点作为头部结点
+    if (timer->expire < head->expire)
+    {
+        timer->next = head;
+        head->prev = timer;
+        head = timer;
+        return;
+    }
+    // 否则调用私有成员，调整内部结点
+    add_timer(timer, head);
+}
+
+// 调整定时器，任务发生变化时，调整定时器在链表中的位置
+template <typename T>
+void sort_timer_lst<T>::adjust_timer(T *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+
+    T *tmp = timer->next;
+    // 被调整的定时器是链表尾结点，或定时器超时值仍然小于下一个定时器超时值，则不调整
+    if (!tmp || (timer->expire < tmp->expire))
+    {
+        return;
+    }
+    // 被调整定时器是链表头结点，将定时器取出，重新插入
+    if (timer == head)
+    {
+        head = head->next;
+        head->prev = NULL;
+        timer->next = NULL;
+        add_timer(timer, head);
+    }
+    // 被调整定时器在内部，将定时器取出，重新插入
+    else
+    {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        add_timer(timer, timer->next);
+    }
+}
+
+// 删除定时器
+template <typename T>
+void sort_timer_lst<T>::del_timer(T *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+
+    // 链表中只有一个定时器，需要删除该定时器
+    if ((timer == head) && (timer == tail))
+    {
+        delete timer;
+        head = NULL;
+        tail = NULL;
+        return;
+    }
+    // 被删除的定时器为头结点
+    if (timer == head)
+    {
+        head = head->next;
+        head->prev = NULL;
+        delete timer;
+        return;
+    }
+    // 被删除的定时器为尾结点
+    if (timer == tail)
+    {
+        tail = tail->prev;
+        tail->next = NULL;
+        delete timer;
+        return;
+    }
+    // 被删除的定时器在链表内部，常规链表结点删除
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    delete timer;
+}
+
+// 定时任务处理函数
+template <typename T>
+void sort_timer_lst<T>::tick()
+{
+    if (!head)
+    {
+        return;
+    }
+
+    time_t cur = m_clock();    // 获取当前时间
+    T *tmp = head;
+    // 遍历定时器链表
+    while (tmp)
+    {
+        // 链表容器为升序排列，若当前时间小于定时器的超时时间，则后面的定时器也没有到期
+        if (cur < tmp->expire)
+        {
+            break;
+        }
+
+        tmp->cb_func(tmp->user_data);  // 当前定时器到期，则调用回调函数，执行定时事件
+        head = tmp->next;              // 将处理后的定时器从链表容器中删除，并重置头结点
+        if (head)
+        {
+            head->prev = NULL;
+        }
+        delete tmp;
+        tmp = head;
+    }
+}
+
+// 最近的到期时间 (链表升序，即头结点的到期时间)
+template <typename T>
+time_t sort_timer_lst<T>::next_expire()
+{
+    return head ? head->expire : 0;
+}
+
+// 用于调整链表内部结点 (私有成员，被公有成员add_timer和adjust_time调用)
+template <typename T>
+void sort_timer_lst<T>::add_timer(T *timer, T *lst_head)
+{
+    T *prev = lst_head;
+    T *tmp = prev->next;
+
+    // 遍历当前结点之后的链表，按照超时时间找到目标定时器对应的位置，常规双向链表插入操作
+    while (tmp)
+    {
+        if (timer->expire < tmp->expire)
+        {
+            prev->next = timer;
+            timer->next = tmp;
+            tmp->prev = timer;
+            timer->prev = prev;
+            break;
+        }
+        prev = tmp;
+        tmp = tmp->next;
+    }
+    // 遍历完发现，目标定时器需要放到尾结点处
+    if (!tmp)
+    {
+        prev->next = timer;
+        timer->prev = prev;
+        timer->next = NULL;
+        tail = timer;
+    }
+}
+
+#endif
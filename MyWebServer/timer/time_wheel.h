@@ -0,0 +1,290 @@
+/*************************************************************
+*分层时间轮定时器容器 (与sort_timer_lst接口相同: add_timer/adjust_timer/del_timer/tick)
+*第1层256个槽，每槽1个时间单位；第2~5层各64个槽，每层的一个槽覆盖下一层的一整圈
+*添加、调整、删除均为O(1)，到期处理均摊O(1) (高层槽位到期时整体下放到低层)
+*T需包含expire、cb_func、user_data、prev、next成员 (MyWebServer和webserver.2的util_timer均满足)
+*支持惰性调整: 只推迟expire而不调用adjust_timer时，结点在原槽位到期后按新的expire重新放入，不执行回调 (提前expire仍需调用adjust_timer)
+*OWNS_TIMER为true时定时器结点由new创建，删除和到期后由容器delete；为false时结点嵌入在连接资源中，容器只负责摘除
+**************************************************************/
+
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <time.h>
+#include <stdint.h>
+
+template <typename T, bool OWNS_TIMER = true>
+class time_wheel
+{
+public:
+    // clock返回当前时间，其单位即为时间轮的最小刻度 (如毫秒或秒)
+    explicit time_wheel(time_t (*clock)());
+    ~time_wheel();
+
+    void add_timer(T *timer);      // 添加定时器
+    void adjust_timer(T *timer);   // 调整定时器 (expire更新后，将其移动到对应的槽位)
+    void del_timer(T *timer);      // 删除定时器
+    void tick();                   // 处理所有已到期的定时器
+    time_t next_expire();          // 下一次需要调用tick的时间 (不晚于最近的到期时间；没有定时器时返回0)
+
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int TVN_LEVELS = 4;
+
+    void link(T *timer);                // 按到期时间放入对应层的槽位
+    static void unlink(T *timer);       // 从所在槽位中摘除
+    static bool empty(T *head)
+    {
+        return head->next == head;
+    }
+    int cascade(int level, int index);  // 将高层的一个槽位整体下放
+
+    T m_tv1[TVR_SIZE];                  // 第1层槽位 (每个元素为循环双向链表的哨兵结点)
+    T m_tvn[TVN_LEVELS][TVN_SIZE];      // 第2~5层槽位
+    uint64_t m_tv1_bitmap[TVR_SIZE / 64];   // 第1层可能非空的槽位 (置位不代表一定非空，清零一定为空)
+    time_t m_current;                   // 下一个待处理的时刻 (之前的槽位均已处理)
+    long m_count;                       // 定时器总数
+    time_t (*m_clock)();                // 时钟
+};
+
+// 构造函数 (所有槽位初始化为空的循环链表)
+template <typename T, bool OWNS_TIMER>
+time_wheel<T, OWNS_TIMER>::time_wheel(time_t (*clock)()) : m_count(0), m_clock(clock)
+{
+    for (int i = 0; i < TVR_SIZE; ++i)
+        m_tv1[i].prev = m_tv1[i].next = &m_tv1[i];
+    for (int l = 0; l < TVN_LEVELS; ++l)
+        for (int i = 0; i < TVN_SIZE; ++i)
+            m_tvn[l][i].prev = m_tvn[l][i].next = &m_tvn[l][i];
+    for (int i = 0; i < TVR_SIZE / 64; ++i)
+        m_tv1_bitmap[i] = 0;
+    m_current = m_clock();
+}
+
+// 析构函数 (销毁所有未到期的定时器；嵌入式结点的内存不属于容器，不再访问)
+template <typename T, bool OWNS_TIMER>
+time_wheel<T, OWNS_TIMER>::~time_wheel()
+{
+    if (!OWNS_TIMER)
+        return;
+    for (int i = 0; i < TVR_SIZE; ++i)
+        while (!empty(&m_tv1[i]))
+        {
+            T *tmp = m_tv1[i].next;
+            unlink(tmp);
+            delete tmp;
+        }
+    for (int l = 0; l < TVN_LEVELS; ++l)
+        for (int i = 0; i < TVN_SIZE; ++i)
+            while (!empty(&m_tvn[l][i]))
+            {
+                T *tmp = m_tvn[l][i].next;
+                unlink(tmp);
+                delete tmp;
+            }
+}
+
+// 按到期时间与当前时刻的差值选择层，再按到期时间的对应位选择槽位
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::link(T *timer)
+{
+    time_t expire = timer->expire;
+    if (expire < m_current)          // 已过期的定时器放入当前槽位，下一次tick即处理
+        expire = m_current;
+    time_t delta = expire - m_current;
+
+    T *head;
+    if (delta < TVR_SIZE)
+    {
+        int index = expire & TVR_MASK;
+        head = &m_tv1[index];
+        m_tv1_bitmap[index >> 6] |= (uint64_t)1 << (index & 63);
+    }
+    else
+    {
+        int level = 0;
+        while (level < TVN_LEVELS - 1 && delta >= ((time_t)1 << (TVR_BITS + (level + 1) * TVN_BITS)))
+            ++level;
+        // 超出最高层范围的定时器放在最高层的最远槽位，下放时再重新计算
+        time_t max_delta = ((time_t)1 << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1;
+        if (delta > max_delta)
+            expire = m_current + max_delta;
+        head = &m_tvn[level][(expire >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+
+    // 插入到槽位链表尾部
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+// 从所在槽位中摘除 (循环链表，无需知道所在槽位)
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::unlink(T *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+// 将高层的一个槽位整体下放 (重新按当前时刻放入更低的层)，返回该槽位下标
+template <typename T, bool OWNS_TIMER>
+int time_wheel<T, OWNS_TIMER>::cascade(int level, int index)
+{
+    T *head = &m_tvn[level][index];
+    T *tmp = head->next;
+    head->prev = head->next = head;   // 先摘下整条链表
+    while (tmp != head)
+    {
+        T *next = tmp->next;
+        link(tmp);
+        tmp = next;
+    }
+    return index;
+}
+
+// 添加定时器
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::add_timer(T *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    link(timer);
+    ++m_count;
+}
+
+// 调整定时器 (expire已更新，直接换到新槽位)
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::adjust_timer(T *timer)
+{
+    if (!timer || !timer->next)
+    {
+        return;
+    }
+    unlink(timer);
+    link(timer);
+}
+
+// 删除定时器
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::del_timer(T *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    if (timer->next)
+    {
+        unlink(timer);
+        --m_count;
+    }
+    if (OWNS_TIMER)
+        delete timer;
+}
+
+// 处理从上次tick到当前时刻之间所有槽位上的定时器
+template <typename T, bool OWNS_TIMER>
+void time_wheel<T, OWNS_TIMER>::tick()
+{
+    time_t cur = m_clock();
+    while (m_current <= cur)
+    {
+        int index = m_current & TVR_MASK;
+
+        // 第1层转完一圈，依次从高层下放一个槽位 (某层下标不为0时说明更高层尚未转到下一槽)
+        if (!index)
+        {
+            int level = 0;
+            while (level < TVN_LEVELS && !cascade(level, (m_current >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK))
+                ++level;
+        }
+
+        // 第1层剩余槽位均为空，直接跳到下一圈的起点
+        bool tv1_empty = true;
+        for (int i = 0; i < TVR_SIZE / 64; ++i)
+            if (m_tv1_bitmap[i])
+                tv1_empty = false;
+        if (tv1_empty)
+        {
+            time_t next_round = (m_current | TVR_MASK) + 1;
+            m_current = next_round <= cur ? next_round : cur + 1;
+            continue;
+        }
+
+        // 执行当前槽位上的所有定时器 (回调函数中可能添加新的定时器，逐个摘下再执行)
+        T *head = &m_tv1[index];
+        while (!empty(head))
+        {
+            T *tmp = head->next;
+            unlink(tmp);
+            if (tmp->expire > m_current)   // expire在放入后被推迟 (惰性调整)，按新的到期时间重新放入
+            {
+                link(tmp);
+                continue;
+            }
+            --m_count;
+            tmp->cb_func(tmp->user_data);
+            if (OWNS_TIMER)
+                delete tmp;
+        }
+        m_tv1_bitmap[index >> 6] &= ~((uint64_t)1 << (index & 63));
+        ++m_current;
+    }
+}
+
+// 下一次需要调用tick的时间: 第1层中最近的非空槽位与高层最近一次下放时刻中较早的一个
+template <typename T, bool OWNS_TIMER>
+time_t time_wheel<T, OWNS_TIMER>::next_expire()
+{
+    if (m_count == 0)
+        return 0;
+
+    // 第1层下标回绕之前的非空槽位一定早于任何高层下放的定时器，回绕之后的 (或恰好位于边界时) 需与高层下放时刻比较
+    time_t next = 0;
+    int index = m_current & TVR_MASK;
+    for (int i = 0; i < TVR_SIZE; ++i)
+    {
+        int slot = (index + i) & TVR_MASK;
+        if ((m_tv1_bitmap[slot >> 6] >> (slot & 63)) & 1)
+        {
+            if (!empty(&m_tv1[slot]))
+            {
+                if (index && i < TVR_SIZE - index)
+                    return m_current + i;
+                next = m_current + i;
+                break;
+            }
+            m_tv1_bitmap[slot >> 6] &= ~((uint64_t)1 << (slot & 63));   // 清除过期的置位
+        }
+    }
+
+    // 第l层中距离为d的槽位在 ((m_current >> shift) + d) << shift 时刻下放
+    // m_current恰好位于该层槽位边界时当前槽位尚未下放 (d取0~63)，否则当前下标对应已转过一圈的槽位 (d取1~64)
+    for (int level = 0; level < TVN_LEVELS; ++level)
+    {
+        int shift = TVR_BITS + level * TVN_BITS;
+        int cur_index = (m_current >> shift) & TVN_MASK;
+        int start = (m_current & (((time_t)1 << shift) - 1)) ? 1 : 0;
+        for (int d = start; d < start + TVN_SIZE; ++d)
+        {
+            if (!empty(&m_tvn[level][(cur_index + d) & TVN_MASK]))
+            {
+                time_t when = ((m_current >> shift) + d) << shift;
+                if (next == 0 || when < next)
+                    next = when;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "uring.h"
+
+// 构造函数
+uring::uring()
+{
+    m_ring_fd = -1;
+    m_sq_ptr = MAP_FAILED;
+    m_cq_ptr = MAP_FAILED;
+    m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    m_sq_size = m_cq_size = m_sqes_size = 0;
+    m_sqe_tail = 0;
+    m_buf_ring = NULL;
+    m_bufs = NULL;
+    m_buf_ring_size = m_bufs_size = 0;
+}
+
+// 析构函数 (解除映射，关闭io_uring实例)
+uring::~uring()
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_ring_fd >= 0)
+        close(m_ring_fd);
+    if (m_buf_ring)
+        munmap(m_buf_ring, m_buf_ring_size);
+    if (m_bufs)
+        munmap(m_bufs, m_bufs_size);
+}
+
+// 创建io_uring实例并映射SQ/CQ环
+bool uring::init(unsigned entries, unsigned cq_entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;    // 每个连接同一时刻最多一个未完成的操作，CQ按最大连接数设置，避免溢出
+    p.cq_entries = cq_entries;
+
+    m_ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (m_ring_fd < 0)
+        return false;
+
+    m_sq_entries = p.sq_entries;
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // SQ数组与SQE一一对应，之后只需推进tail
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+        m_sq_array[i] = i;
+    m_sqe_tail = *m_sq_tail;
+    return true;
+}
+
+// 查询内核是否支持某个操作码
+bool uring::probe(int opcode)
+{
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *p = (struct io_uring_probe *)calloc(1, len);
+    if (!p)
+        return false;
+
+    bool ok = false;
+    if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PROBE, p, 256) == 0)
+        ok = opcode <= p->last_op && (p->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    free(p);
+    return ok;
+}
+
+// 获取一个空闲的SQE
+struct io_uring_sqe *uring::get_sqe()
+{
+    if (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+    {
+        if (submit_and_wait(0) < 0)
+            return NULL;
+        if (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+            return NULL;
+    }
+    struct io_uring_sqe *sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    m_sqe_tail++;
+    return sqe;
+}
+
+// 提交所有未提交的SQE，并至少等待wait_nr个完成事件
+int uring::submit_and_wait(unsigned wait_nr)
+{
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+
+    int ret = syscall(__NR_io_uring_enter, m_ring_fd, to_submit, wait_nr, flags, NULL, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+// 取出一个完成事件
+struct io_uring_cqe *uring::peek_cqe()
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &m_cqes[head & *m_cq_mask];
+}
+
+// 标记当前完成事件已处理
+void uring::cqe_seen()
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// 注册缓冲区环 (环和缓冲区的内存都用mmap分配，环需要按页对齐)
+bool uring::setup_buf_ring(unsigned entries, unsigned size)
+{
+    m_buf_ring_size = entries * sizeof(struct io_uring_buf);
+    void *ring = mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    m_bufs_size = (size_t)entries * size;
+    void *bufs = mmap(0, m_bufs_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED)
+    {
+        munmap(ring, m_buf_ring_size);
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = entries;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(ring, m_buf_ring_size);
+        munmap(bufs, m_bufs_size);
+        return false;
+    }
+
+    m_buf_ring = (struct io_uring_buf *)ring;
+    m_bufs = (char *)bufs;
+    m_buf_size = size;
+    m_buf_mask = entries - 1;
+    m_buf_tail = 0;
+    for (unsigned i = 0; i < entries; ++i)
+        put_buf(i);
+    return true;
+}
+
+// 把缓冲区放回环中 (先填好环中的项，再以release语义推进tail，内核看到新的tail时该项一定已写好)
+// 不使用io_uring_buf_ring::bufs: C++中__DECLARE_FLEX_ARRAY展开后多出一个空结构体成员，bufs的偏移不再是0
+void uring::put_buf(int bid)
+{
+    struct io_uring_buf *buf = &m_buf_ring[m_buf_tail & m_buf_mask];
+    buf->addr = (uint64_t)(uintptr_t)get_buf(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    m_buf_tail++;
+    __atomic_store_n(&m_buf_ring[0].resv, m_buf_tail, __ATOMIC_RELEASE);
+}
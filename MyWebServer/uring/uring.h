@@ -0,0 +1,124 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// io_uring的最小封装 (直接使用系统调用，不依赖liburing)
+class uring
+{
+public:
+    uring();
+    ~uring();
+
+    // 创建io_uring实例并映射SQ/CQ环 (内核不支持时返回false，调用者回退到epoll)
+    bool init(unsigned entries, unsigned cq_entries);
+
+    // 查询内核是否支持某个操作码
+    bool probe(int opcode);
+
+    // 获取一个空闲的SQE (SQ已满时先提交再获取)
+    struct io_uring_sqe *get_sqe();
+
+    // 提交所有未提交的SQE，并至少等待wait_nr个完成事件 (返回负的errno表示出错)
+    int submit_and_wait(unsigned wait_nr);
+
+    // 取出一个完成事件 (没有则返回NULL)，处理完后调用cqe_seen
+    struct io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    // 注册缓冲区环 (provided buffers，内核5.19起支持): entries个大小为size的缓冲区 (entries为2的幂)，不支持时返回false
+    // 用prep_recv_select提交的recv不指定缓冲区，数据到达时内核才从环中取出一个，完成事件的flags中带有其编号
+    bool setup_buf_ring(unsigned entries, unsigned size);
+    bool has_buf_ring()
+    {
+        return m_buf_ring != NULL;
+    }
+    char *get_buf(int bid)    // 编号为bid的缓冲区
+    {
+        return m_bufs + (size_t)bid * m_buf_size;
+    }
+    void put_buf(int bid);    // 数据取走后把缓冲区放回环中
+
+    // 以下为常用操作的SQE填充函数
+    static void prep_accept(struct io_uring_sqe *sqe, int fd, struct sockaddr *addr, socklen_t *addrlen, bool multishot, uint64_t user_data)
+    {
+        prep_rw(sqe, IORING_OP_ACCEPT, fd, addr, 0, (uint64_t)(uintptr_t)addrlen, user_data);
+        if (multishot)
+            sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    }
+    static void prep_recv(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t user_data)
+    {
+        prep_rw(sqe, IORING_OP_RECV, fd, buf, len, 0, user_data);
+    }
+    static void prep_recv_select(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+    {
+        prep_rw(sqe, IORING_OP_RECV, fd, NULL, 0, 0, user_data);    // 长度为0表示使用所选缓冲区的全部长度
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+    }
+    static void prep_writev(struct io_uring_sqe *sqe, int fd, const struct iovec *iov, unsigned count, uint64_t user_data)
+    {
+        prep_rw(sqe, IORING_OP_WRITEV, fd, iov, count, 0, user_data);
+    }
+    static void prep_poll_add(struct io_uring_sqe *sqe, int fd, unsigned poll_mask, uint64_t user_data)
+    {
+        prep_rw(sqe, IORING_OP_POLL_ADD, fd, NULL, 0, 0, user_data);
+        sqe->poll32_events = poll_mask;
+    }
+
+private:
+    static const int BUF_GROUP = 0;    // 缓冲区环的组号
+
+    static void prep_rw(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned len, uint64_t off, uint64_t user_data)
+    {
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->user_data = user_data;
+    }
+
+private:
+    int m_ring_fd;               // io_uring实例的文件描述符
+    unsigned m_sq_entries;       // SQ大小
+
+    void *m_sq_ptr;              // SQ环映射地址
+    size_t m_sq_size;
+    void *m_cq_ptr;              // CQ环映射地址 (IORING_FEAT_SINGLE_MMAP时与SQ环共用)
+    size_t m_cq_size;
+    struct io_uring_sqe *m_sqes; // SQE数组
+    size_t m_sqes_size;
+
+    unsigned *m_sq_head;         // 内核消费位置
+    unsigned *m_sq_tail;         // 用户生产位置 (对内核可见)
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned m_sqe_tail;         // 本地已填充的SQE位置 (提交时才写回m_sq_tail)
+
+    unsigned *m_cq_head;         // 用户消费位置
+    unsigned *m_cq_tail;         // 内核生产位置
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes; // CQE数组
+
+    struct io_uring_buf *m_buf_ring;   // 缓冲区环 (与内核共享，为NULL表示未注册。按io_uring_buf数组访问，tail与第0项的resv重叠)
+    size_t m_buf_ring_size;
+    char *m_bufs;                // 环中各缓冲区的内存 (连续分配，按编号定位)
+    size_t m_bufs_size;
+    unsigned m_buf_size;         // 每个缓冲区的大小
+    unsigned m_buf_mask;         // 环的大小-1
+    unsigned short m_buf_tail;   // 本地的生产位置 (放回缓冲区后写回环的tail)
+};
+
+#endif
@@ -1,5 +1,22 @@
 #include "webserver.h"
 
+// io_uring的user_data编码: 操作类型(8位) | 连接代数(24位) | fd(32位)，用于识别fd复用后的过期完成事件
+enum URING_OP
+{
+    URING_ACCEPT = 1,
+    URING_RECV,
+    URING_SEND,
+    URING_SIGNAL,
+    URING_TIMER
+};
+
+const int URING_BUF_NUM = 1024;    // 缓冲区环中的缓冲区数 (每个为读缓冲区的最小一级，只在数据到达后、复制到读缓冲区之前被占用)
+
+static uint64_t uring_data(int op, unsigned int generation, int fd)
+{
+    return ((uint64_t)op << 56) | ((uint64_t)(generation & 0xffffff) << 32) | (uint32_t)fd;
+}
+
 // 构造函数
 WebServer::WebServer()
 {
@@ -16,6 +33,14 @@ WebServer::WebServer()
 
     // 预先为每个可能的客户连接分配一个关于定时器的连接资源
     users_timer = new client_data[MAX_FD];
+
+    m_listenfd = -1;
+    m_epollfd = -1;
+    m_completionfd = -1;
+    m_signalfd = -1;
+    m_uring = NULL;
+    m_pool = NULL;
+    m_reactors = NULL;
 }
 
 // 析构函数
@@ -23,8 +48,9 @@ WebServer::~WebServer()
 {
     close(m_epollfd);
     close(m_listenfd);
-    close(m_pipefd[1]);
-    close(m_pipefd[0]);
+    close(m_signalfd);
+    delete[] m_reactors;
+    delete m_uring;
     delete[] users;
     delete[] users_timer;
     delete m_pool;
@@ -32,7 +58,8 @@ WebServer::~WebServer()
 
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write, 
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model, int reactor_num, int io_backend,
+                     int header_timeout, int body_timeout, int idle_timeout, int write_timeout, int max_requests, int sendfile_threshold, int cache_size, string max_age)
 {
     m_port = port;
     m_user = user;
@@ -45,6 +72,29 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+
+    // 子反应堆数量默认取CPU核数
+    m_reactor_num = reactor_num;
+    if (m_reactor_num <= 0)
+        m_reactor_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (m_reactor_num <= 0)
+        m_reactor_num = 1;
+
+    m_io_backend = io_backend;
+
+    m_timeout[TIMEOUT_HEADER] = header_timeout;
+    m_timeout[TIMEOUT_BODY] = body_timeout;
+    m_timeout[TIMEOUT_IDLE] = idle_timeout;
+    m_timeout[TIMEOUT_WRITE] = write_timeout;
+    http_conn::m_max_requests = max_requests;
+    http_conn::m_sendfile_threshold = sendfile_threshold;
+    blob_cache::get_instance()->init((long long)cache_size << 20);
+    m_max_age = max_age;
+
+    // 屏蔽SIGTERM、SIGHUP并创建signalfd (之后创建的日志、线程池、子反应堆线程都继承该屏蔽字，信号统一由主线程的事件循环读取)
+    const int sigs[] = {SIGTERM, SIGHUP};
+    m_signalfd = Utils::create_signalfd(sigs, sizeof(sigs) / sizeof(sigs[0]));
+    assert(m_signalfd != -1);
 }
 
 // 设置listenfd和connfd的模式组合 (ET或LT)
@@ -103,6 +153,10 @@ void WebServer::sql_pool()
  // 创建并初始化线程池
 void WebServer::thread_pool()
 {
+    // multi-reactor模式下线程池是可选的 (线程数为0时，由子反应堆线程直接处理请求)
+    if (2 == m_actormodel && m_thread_num <= 0)
+        return;
+
     // 线程池
     m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
 }
@@ -110,6 +164,22 @@ void WebServer::thread_pool()
 // 设置监听套接字 (设置监听套接字，是否优雅关闭连接，设置定时器超时时间，创建内核时间表、管道、信号注册)
 void WebServer::eventListen()
 {
+    // 静态文件缓存监视网站根目录的变化 (失败时缓存项只依靠TTL过期)
+    if (!file_cache::get_instance()->init(m_root))
+        LOG_ERROR("%s", "inotify watch on root failed, file cache relies on TTL");
+    if (!file_cache::get_instance()->set_max_age(m_max_age.c_str()))
+        LOG_ERROR("invalid max-age rules: %s", m_max_age.c_str());
+
+    // 内置路由 (静态文件、跳转页面、登录和注册)
+    http_conn::init_routes();
+
+    // multi-reactor: 每个子反应堆各自创建SO_REUSEPORT监听套接字，主线程只负责信号处理
+    if (2 == m_actormodel)
+    {
+        eventListenMulti();
+        return;
+    }
+
     // 网络编程基础步骤
     m_listenfd = socket(PF_INET, SOCK_STREAM, 0);   // 创建套接字
     assert(m_listenfd >= 0);
@@ -140,30 +210,103 @@ void WebServer::eventListen()
     ret = listen(m_listenfd, 5);    // 指定m_listenfd为监听套接字，并创建监听队列(长度为5)
     assert(ret >= 0);
 
-    utils.init(TIMESLOT);   // 设置超时时间
+    utils.init(m_timeout);   // 设置各阶段的超时时间
+
+    // io_uring后端 (内核不支持时回退到epoll)
+    if (1 == m_io_backend)
+    {
+        if (eventListenUring())
+        {
+            http_conn::m_sendfile_threshold = -1;    // io_uring后端由一个writev请求发送整组iovec，文件内容仍使用mmap
+            return;
+        }
+        LOG_ERROR("%s", "io_uring is not supported, fall back to epoll");
+        m_io_backend = 0;
+    }
 
     // epoll创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);
 
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);   // 向内核事件表注册监听套接字
-    http_conn::m_epollfd = m_epollfd;                              // 统一内核事件表
 
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);   // 创建双向管道
-    assert(ret != -1);
-    utils.setnonblocking(m_pipefd[1]);                     // 设置管道写端为非阻塞 (工作线程端写)
-    utils.addfd(m_epollfd, m_pipefd[0], false, 0);         // 设置管道读端为ET非阻塞，并添加到epoll内核事件表 (主线程端读)
+    // 注册线程池的完成通知eventfd (reactor和proactor)
+    if (m_actormodel < 2)
+    {
+        m_completionfd = m_pool->get_completion()->get_fd();
+        utils.addfd(m_epollfd, m_completionfd, false, 0);
+    }
+
+    eventSignal();
+}
 
-    // 注册信号SIGGPIPE、SIGALRM、SIGTERM
-    utils.addsig(SIGPIPE, SIG_IGN);               // 屏蔽SIGPIPE信号 (在linux下写socket的程序的时候，如果尝试send到一个disconnected socket上，就会让底层抛出一个SIGPIPE信号。这个信号的缺省处理方法是退出进程)
-    utils.addsig(SIGALRM, utils.sig_handler, false);
-    utils.addsig(SIGTERM, utils.sig_handler, false);
+// multi-reactor: 创建并启动子反应堆 (每个子反应堆独占一个线程、一个epoll内核事件表、一个SO_REUSEPORT监听套接字和一个定时器容器)
+void WebServer::eventListenMulti()
+{
+    utils.init(m_timeout);
 
-    alarm(TIMESLOT);    // alarm(): 设置信号传送闹钟，即用来设置信号SIGALRM在经过参数seconds秒数后发送给目前的进程
+    // 主线程的内核事件表只注册signalfd
+    m_epollfd = epoll_create(5);
+    assert(m_epollfd != -1);
 
-    // 工具类,信号和描述符基础操作
-    Utils::u_pipefd = m_pipefd;
+    eventSignal();
+
+    m_reactors = new sub_reactor[m_reactor_num];
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        bool ok = m_reactors[i].init(i, m_port, m_OPT_LINGER, m_LISTENTrigmode, m_CONNTrigmode, m_timeout,
+                                     users, users_timer, m_root, m_user, m_passWord, m_databaseName,
+                                     m_pool, m_connPool, m_close_log);
+        assert(ok);
+    }
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        bool ok = m_reactors[i].start();
+        assert(ok);
+    }
+}
+
+// io_uring: 创建io_uring实例，提交accept以及signalfd、timerfd上的读就绪监听 (失败返回false，调用者回退到epoll)
+bool WebServer::eventListenUring()
+{
+    m_uring = new uring;
+    if (!m_uring->init(4096, MAX_FD) || !m_uring->probe(IORING_OP_ACCEPT) || !m_uring->probe(IORING_OP_RECV) ||
+        !m_uring->probe(IORING_OP_WRITEV) || !m_uring->probe(IORING_OP_POLL_ADD))
+    {
+        delete m_uring;
+        m_uring = NULL;
+        return false;
+    }
+    m_accept_multishot = true;
+    utils.setnonblocking(m_listenfd);
+
+    // 缓冲区环: 空闲连接上未完成的recv不占用缓冲区 (内核不支持时每个连接的recv直接接收到自己的读缓冲区中)
+    if (!m_uring->setup_buf_ring(URING_BUF_NUM, buffer_pool::MIN_SIZE))
+        LOG_INFO("%s", "io_uring provided buffers are not supported, recv into per-connection buffers");
+
+    eventSignal();    // 连接不注册到epoll (m_epollfd为-1)，signalfd和timerfd由io_uring监听
+
+    uring_submit_accept();
+    uring_submit_poll(URING_SIGNAL, m_signalfd);
+    uring_submit_poll(URING_TIMER, m_timerfd);
+    return true;
+}
+
+// 创建timerfd，并将signalfd和timerfd注册到内核事件表
+void WebServer::eventSignal()
+{
+    utils.addsig(SIGPIPE, SIG_IGN);    // 屏蔽SIGPIPE信号 (在linux下写socket的程序的时候，如果尝试send到一个disconnected socket上，就会让底层抛出一个SIGPIPE信号。这个信号的缺省处理方法是退出进程)
+
+    m_timerfd = utils.create_timerfd();   // 定时器容器中最近的定时器到期时可读 (毫秒精度，取代alarm和SIGALRM)
+    assert(m_timerfd != -1);
+
+    if (m_epollfd >= 0)
+    {
+        utils.addfd(m_epollfd, m_signalfd, false, 0);
+        utils.addfd(m_epollfd, m_timerfd, false, 0);
+    }
+
+    // 工具类,描述符基础操作
     Utils::u_epollfd = m_epollfd;
 }
 
@@ -171,40 +314,44 @@ void WebServer::eventListen()
 void WebServer::timer(int connfd, struct sockaddr_in client_address)
 {
      // 初始化http新连接
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);  
+    users[connfd].init(m_epollfd, connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);  
 
-    // 初始化client_data数据 (创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中)
+    // 初始化client_data数据 (设置回调函数和超时时间，绑定用户数据，将定时器添加到定时器容器中)
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;       // 创建定时器timer
+    users_timer[connfd].epollfd = m_epollfd;
+    util_timer *timer = &users_timer[connfd].timer_node;   // 使用嵌入的定时器结点
     timer->user_data = &users_timer[connfd];  // 初始化定时器timer
-    timer->cb_func = cb_func;                 // 设置定时器回调函数
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;       // 定时器初始为当前时间+三个超时单位
+    timer->cb_func = m_uring ? uring_timeout_cb_func : timeout_cb_func;   // 设置定时器回调函数
+    timer->expire = utils.m_now + utils.m_timeout[TIMEOUT_HEADER];      // 新连接需在请求头超时时间内发来完整的请求头
+    users_timer[connfd].timeout_type = TIMEOUT_HEADER;
+    users_timer[connfd].pending = 0;
+    users_timer[connfd].expired = false;
     users_timer[connfd].timer = timer;
+    users[connfd].m_done = m_pool ? m_pool->get_completion() : NULL;
     utils.m_timer_lst.add_timer(timer);       // 插入该定时器timer
+    utils.arm_timer();                        // 必要时提前timerfd
 }
 
-// 调整定时器 (若有数据传输，则将定时器往后延迟3个单位，并对新的定时器在链表上的位置进行调整)
-void WebServer::adjust_timer(util_timer *timer)
+// 调整定时器 (按连接当前所处阶段设置超时时间，需在没有工作线程处理该连接时调用)
+// 推迟时只按缓存的时钟更新expire，不移动结点；原到期时间到达时由时间轮按新的expire重新放入
+void WebServer::adjust_timer(int sockfd)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
-
-    LOG_INFO("%s", "adjust timer once");   // log日志打印
+    utils.set_timeout(&users_timer[sockfd], users[sockfd].timeout_type(), users[sockfd].get_content_length());
 }
 
 // 回收资源 (删除对应的定时器、注册事件，关闭对应文件描述符）
 void WebServer::deal_timer(util_timer *timer, int sockfd)
 {
-    timer->cb_func(&users_timer[sockfd]);     // 调用回调函数 (删除对于注册事件，关闭对应文件描述符，减少连接数)
-    if (timer)
-    {
-        utils.m_timer_lst.del_timer(timer);   // 删除定时器
-    }
+    if (!users_timer[sockfd].timer)
+        return;                               // 连接已关闭 (如本轮中已到期)，不能再次close和减少连接数
+    utils.m_timer_lst.del_timer(timer);       // 先从容器中摘除定时器 (结点嵌入在连接资源中，fd关闭后可能立即被新连接复用)
+    if (m_uring)                              // 关闭连接 (删除对于注册事件，关闭对应文件描述符，减少连接数)
+        uring_cb_func(&users_timer[sockfd]);
+    else
+        cb_func(&users_timer[sockfd]);
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    LOG_INFO("close fd %d", sockfd);
 }
 
 // 接收客户连接 (ET,LT)
@@ -254,70 +401,106 @@ bool WebServer::dealclinetdata()
     return true;
 }
 
-// 信号处理 (SIGALRM,SIGTERM)
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
+// 信号处理 (从signalfd读取SIGTERM、SIGHUP)
+bool WebServer::dealwithsignal(bool &stop_server)
 {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1)
-    {
-        return false;
-    }
-    else if (ret == 0)
+    struct signalfd_siginfo info[16];
+    int ret = read(m_signalfd, info, sizeof(info));
+    if (ret <= 0)
     {
         return false;
     }
-    else
+
+    for (int i = 0; i < ret / (int)sizeof(info[0]); ++i)
     {
-        for (int i = 0; i < ret; ++i)
+        switch (info[i].ssi_signo)
         {
-            switch (signals[i])
-            {
-            case SIGALRM:  // 由alarm设置的实时闹钟超时引起
-            {
-                timeout = true;
-                break;
-            }
-            case SIGTERM:  // 终止进程
-            {
-                stop_server = true;
-                break;
-            }
-            }
+        case SIGTERM:  // 终止进程
+        {
+            stop_server = true;
+            log_expired();
+            log_cache();
+            break;
+        }
+        case SIGHUP:   // 刷新日志，并记录各类超时次数和内存缓存的统计
+        {
+            LOG_INFO("%s", "SIGHUP received");
+            log_expired();
+            log_cache();
+            break;
+        }
         }
     }
     return true;
 }
 
+// 记录各类超时关闭的连接数
+void WebServer::log_expired()
+{
+    LOG_INFO("expired connections: header %d, body %d, idle %d, write %d",
+             Utils::u_expired[TIMEOUT_HEADER].load(), Utils::u_expired[TIMEOUT_BODY].load(),
+             Utils::u_expired[TIMEOUT_IDLE].load(), Utils::u_expired[TIMEOUT_WRITE].load());
+}
+
+// 记录内存缓存的命中、准入和淘汰次数
+void WebServer::log_cache()
+{
+    blob_stats s = blob_cache::get_instance()->stats();
+    LOG_INFO("memory cache: hits %lld, misses %lld, admissions %lld, rejections %lld, evictions %lld, bytes %lld",
+             s.hits, s.misses, s.admissions, s.rejections, s.evictions, s.bytes);
+}
+
+// 处理工作线程投递的完成通知 (I/O失败或处理期间定时器已到期的连接由主线程关闭并删除定时器，其余连接按处理后的阶段调整定时器)
+void WebServer::dealwithcompletion()
+{
+    m_pool->get_completion()->drain(m_completions);
+    for (size_t i = 0; i < m_completions.size(); ++i)
+    {
+        const completion &c = m_completions[i];
+
+        // 连接已被关闭 (或fd已被新连接复用)，丢弃过期通知
+        util_timer *timer = users_timer[c.sockfd].timer;
+        if (!timer || users[c.sockfd].m_generation != c.generation)
+            continue;
+
+        users_timer[c.sockfd].pending--;
+        if (c.timer_flag || (users_timer[c.sockfd].expired && 0 == users_timer[c.sockfd].pending))
+            deal_timer(timer, c.sockfd);    // I/O失败，或定时器已在工作线程处理期间到期
+        else if (0 == users_timer[c.sockfd].pending)   // 该连接已重新注册事件时可能又有任务在处理，此时其状态仍在变化，等最后一个任务完成再调整
+            adjust_timer(c.sockfd);
+    }
+}
+
+// proactor: 把读缓冲区中的请求放入请求队列 (工作线程处理期间连接不能被关闭: 定时器到期时只做标记，由完成通知到达后关闭)
+void WebServer::dealwithrequest(int sockfd)
+{
+    users_timer[sockfd].pending++;
+    if (!m_pool->append_p(users + sockfd))
+    {
+        users_timer[sockfd].pending--;
+        LOG_ERROR("%s", "request queue full");
+        deal_timer(users_timer[sockfd].timer, sockfd);    // 请求数据已从socket中读出，无法稍后再投递，关闭连接
+    }
+}
+
 // 接收客户数据
 void WebServer::dealwithread(int sockfd)
 {
     util_timer *timer = users_timer[sockfd].timer;
 
+    // 定时器已到期，等工作线程的完成通知到达后关闭，不再投递新任务
+    if (users_timer[sockfd].expired)
+        return;
+
     // reactor (由工作线程处理可读或可写事件，主线程只负责监听是否有事件发生)
     if (1 == m_actormodel)
     {
-        if (timer)   
-        {
-            adjust_timer(timer);   // 调整对应的定时器
-        }
-
-        m_pool->append(users + sockfd, 0);   // 主线程若监测到读事件，将该事件放入请求队列 (读为0)
-
-        while (true)
+        // 主线程若监测到读事件，将该事件放入请求队列 (读为0)。处理结果由工作线程通过完成通知队列返回，主线程不等待，收到通知后再调整定时器
+        users_timer[sockfd].pending++;
+        if (!m_pool->append(users + sockfd, 0))
         {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
+            users_timer[sockfd].pending--;
+            modfd(m_epollfd, sockfd, EPOLLIN, m_CONNTrigmode);   // 请求队列已满，重新注册事件，稍后再投递
         }
     }
     // proactor (工作线程仅负责处理逻辑，I/O操作都交给主线程和内核来处理进行)
@@ -327,12 +510,8 @@ void WebServer::dealwithread(int sockfd)
         {
             LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));   // log日志打印
 
-            m_pool->append_p(users + sockfd);   // 若监测到读事件，将该事件放入请求队列
-
-            if (timer)
-            {
-                adjust_timer(timer);    // 调整对应的定时器
-            }
+            adjust_timer(sockfd);       // 调整对应的定时器 (需在放入请求队列之前，之后工作线程会修改连接状态)
+            dealwithrequest(sockfd);    // 若监测到读事件，将该事件放入请求队列
         }
         else   // 数据读取失败，则关闭连接，并回收资源
         {
@@ -346,28 +525,17 @@ void WebServer::dealwithwrite(int sockfd)
 {
     util_timer *timer = users_timer[sockfd].timer;
 
+    if (users_timer[sockfd].expired)
+        return;
+
     // reactor
     if (1 == m_actormodel)
     {
-        if (timer)
-        {
-            adjust_timer(timer);   // 调整对应的定时器
-        }
-
-        m_pool->append(users + sockfd, 1);    // 主线程若监测到写事件，将该事件放入请求队列 (写为1)
-
-        while (true)
+        users_timer[sockfd].pending++;
+        if (!m_pool->append(users + sockfd, 1))    // 主线程若监测到写事件，将该事件放入请求队列 (写为1)
         {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
+            users_timer[sockfd].pending--;
+            modfd(m_epollfd, sockfd, EPOLLOUT, m_CONNTrigmode);
         }
     }
     // proactor
@@ -377,10 +545,9 @@ void WebServer::dealwithwrite(int sockfd)
         {
             LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));   // log打印日志
 
-            if (timer)
-            {
-                adjust_timer(timer);   // 调整对应的定时器
-            }
+            adjust_timer(sockfd);   // 调整对应的定时器 (仍有数据待发送时为发送停滞超时，长连接发送完毕时为空闲超时)
+            if (users[sockfd].has_buffered_request())   // 读缓冲区中还有流水线请求，直接放入请求队列
+                dealwithrequest(sockfd);
         }
         else   // 数据写入失败，则关闭连接，并回收资源
         {
@@ -389,9 +556,244 @@ void WebServer::dealwithwrite(int sockfd)
     }
 }
 
+// 提交accept (优先使用multishot，一次提交持续产生新连接)
+void WebServer::uring_submit_accept()
+{
+    struct io_uring_sqe *sqe = m_uring->get_sqe();
+    if (!sqe)
+    {
+        LOG_ERROR("%s", "io_uring sq full");
+        return;
+    }
+    if (m_accept_multishot)
+    {
+        uring::prep_accept(sqe, m_listenfd, NULL, NULL, true, uring_data(URING_ACCEPT, 0, m_listenfd));
+    }
+    else
+    {
+        m_accept_addrlen = sizeof(m_accept_addr);
+        uring::prep_accept(sqe, m_listenfd, (struct sockaddr *)&m_accept_addr, &m_accept_addrlen, false, uring_data(URING_ACCEPT, 0, m_listenfd));
+    }
+}
+
+// 提交recv: 读缓冲区为空 (等待新请求的空闲连接) 时从缓冲区环中取缓冲区，等待期间不借用读缓冲区；
+// 请求不完整时 (或select为false) 直接接收到该连接的读缓冲区中，无需再拷贝
+void WebServer::uring_submit_recv(int sockfd, bool select)
+{
+    struct io_uring_sqe *sqe = m_uring->get_sqe();
+    if (!sqe)
+    {
+        deal_timer(users_timer[sockfd].timer, sockfd);
+        return;
+    }
+    uint64_t data = uring_data(URING_RECV, users[sockfd].m_generation, sockfd);
+    if (select && m_uring->has_buf_ring() && users[sockfd].read_buf_empty())
+    {
+        uring::prep_recv_select(sqe, sockfd, data);
+        return;
+    }
+    int len;
+    char *buf = users[sockfd].get_read_tail(&len);
+    uring::prep_recv(sqe, sockfd, buf, len, data);
+}
+
+// 提交writev (响应报文头部和文件内容一次聚集发送)
+void WebServer::uring_submit_send(int sockfd)
+{
+    int count;
+    struct iovec *iv = users[sockfd].get_iv(&count);
+    struct io_uring_sqe *sqe = m_uring->get_sqe();
+    if (!sqe)
+    {
+        deal_timer(users_timer[sockfd].timer, sockfd);
+        return;
+    }
+    uring::prep_writev(sqe, sockfd, iv, count, uring_data(URING_SEND, users[sockfd].m_generation, sockfd));
+}
+
+// 监听signalfd或timerfd的读就绪事件 (就绪后复用dealwithsignal、timer_handler处理)
+void WebServer::uring_submit_poll(int op, int fd)
+{
+    struct io_uring_sqe *sqe = m_uring->get_sqe();
+    if (sqe)
+        uring::prep_poll_add(sqe, fd, POLLIN, uring_data(op, 0, fd));
+}
+
+// io_uring: 接收到新连接
+void WebServer::uring_accept(int res, unsigned flags)
+{
+    // 内核不支持multishot accept时，退化为每次accept后重新提交
+    if (res == -EINVAL && m_accept_multishot)
+    {
+        m_accept_multishot = false;
+        uring_submit_accept();
+        return;
+    }
+
+    if (res >= 0)
+    {
+        int connfd = res;
+        struct sockaddr_in client_address = m_accept_addr;
+        if (m_accept_multishot)
+        {
+            socklen_t len = sizeof(client_address);
+            getpeername(connfd, (struct sockaddr *)&client_address, &len);
+        }
+
+        if (http_conn::m_user_count >= MAX_FD)
+        {
+            utils.show_error(connfd, "Internal server busy");
+            LOG_ERROR("%s", "Internal server busy");
+        }
+        else
+        {
+            timer(connfd, client_address);
+            uring_submit_recv(connfd);
+        }
+    }
+    else
+    {
+        LOG_ERROR("%s:errno is:%d", "accept error", -res);
+    }
+
+    // multishot accept结束 (或单次accept) 后重新提交
+    if (!(flags & IORING_CQE_F_MORE))
+        uring_submit_accept();
+}
+
+// io_uring: recv完成 (在事件循环线程内直接解析请求并生成响应。bid为数据所在的缓冲区环中的缓冲区，复制后立即放回，-1表示直接接收到了读缓冲区中)
+void WebServer::uring_recv(int sockfd, int res, int bid)
+{
+    util_timer *timer = users_timer[sockfd].timer;
+
+    // 缓冲区环暂时用完，改为接收到该连接的读缓冲区中
+    if (-ENOBUFS == res)
+    {
+        uring_submit_recv(sockfd, false);
+        return;
+    }
+
+    int ret = -1;
+    if (res > 0)   // res为0表示对方关闭连接
+    {
+        connectionRAII mysqlcon(&users[sockfd].mysql, m_connPool);
+        ret = bid >= 0 ? users[sockfd].read_done(m_uring->get_buf(bid), res) : users[sockfd].read_done(res);
+    }
+    if (bid >= 0)
+        m_uring->put_buf(bid);
+
+    if (ret < 0)
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+    adjust_timer(sockfd);
+
+    if (ret == 0)
+        uring_submit_recv(sockfd);
+    else
+        uring_submit_send(sockfd);
+}
+
+// io_uring: writev完成
+void WebServer::uring_send(int sockfd, int res)
+{
+    util_timer *timer = users_timer[sockfd].timer;
+
+    int ret = users[sockfd].write_done(res);
+    if (0 == ret && users[sockfd].has_buffered_request())   // 读缓冲区中还有流水线请求，直接解析而不提交recv
+    {
+        connectionRAII mysqlcon(&users[sockfd].mysql, m_connPool);
+        ret = users[sockfd].read_done(0);
+    }
+    if (ret < 0)
+    {
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+    adjust_timer(sockfd);
+
+    if (ret == 0)
+        uring_submit_recv(sockfd);
+    else
+        uring_submit_send(sockfd);
+}
+
+// io_uring: 循环提交I/O并处理完成事件 (每个连接同一时刻只有一个未完成的recv或writev)
+void WebServer::eventLoopUring()
+{
+    bool stop_server = false;
+
+    while (!stop_server)
+    {
+        int ret = m_uring->submit_and_wait(1);
+        if (ret < 0 && ret != -EINTR)
+        {
+            LOG_ERROR("%s", "io_uring failure");
+            break;
+        }
+        utils.update_now();
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = m_uring->peek_cqe()) != NULL)
+        {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            m_uring->cqe_seen();
+
+            int op = data >> 56;
+            unsigned int generation = (data >> 32) & 0xffffff;
+            int sockfd = (int)(uint32_t)data;
+            int bid = (flags & IORING_CQE_F_BUFFER) ? (int)(flags >> IORING_CQE_BUFFER_SHIFT) : -1;   // recv从缓冲区环中取出的缓冲区
+
+            if (URING_ACCEPT == op)
+            {
+                uring_accept(res, flags);
+            }
+            else if (URING_SIGNAL == op)
+            {
+                if (!dealwithsignal(stop_server))
+                    LOG_ERROR("%s", "dealclientdata failure");
+                uring_submit_poll(URING_SIGNAL, m_signalfd);
+            }
+            else if (URING_TIMER == op)
+            {
+                utils.timer_handler();   // 处理到期的定时器，并重新设置timerfd
+                uring_submit_poll(URING_TIMER, m_timerfd);
+            }
+            // 连接已被关闭 (如定时器到期) 或fd已被新连接复用，丢弃过期的完成事件
+            else if (!users_timer[sockfd].timer || (users[sockfd].m_generation & 0xffffff) != generation)
+            {
+                if (bid >= 0)
+                    m_uring->put_buf(bid);   // 过期的recv取出的缓冲区同样要放回
+                continue;
+            }
+            else if (URING_RECV == op)
+            {
+                uring_recv(sockfd, res, bid);
+            }
+            else if (URING_SEND == op)
+            {
+                uring_send(sockfd, res);
+            }
+        }
+    }
+}
+
 // 循环监听并处理事件
 void WebServer::eventLoop()
 {
+    if (m_uring)
+    {
+        eventLoopUring();
+        return;
+    }
+
     bool timeout = false;
     bool stop_server = false;
 
@@ -403,6 +805,7 @@ void WebServer::eventLoop()
             LOG_ERROR("%s", "epoll failure");
             break;
         }
+        utils.update_now();   // 本轮事件统一使用的时钟
 
         for (int i = 0; i < number; i++)
         {
@@ -422,12 +825,22 @@ void WebServer::eventLoop()
                 deal_timer(timer, sockfd);    // 服务器端关闭连接，移除对应的定时器
             }
             // 处理信号
-            else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
+            else if ((sockfd == m_signalfd) && (events[i].events & EPOLLIN))
             {
-                bool flag = dealwithsignal(timeout, stop_server);
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");    // log日志打印"信号处理错误"
             }
+            // 定时器到期 (本轮其余事件处理完之后再执行定时任务，避免本轮中稍后的事件作用于刚刚关闭的连接)
+            else if ((sockfd == m_timerfd) && (events[i].events & EPOLLIN))
+            {
+                timeout = true;
+            }
+            // 处理工作线程的完成通知
+            else if ((sockfd == m_completionfd) && (events[i].events & EPOLLIN))
+            {
+                dealwithcompletion();
+            }
             // 处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
             {
@@ -442,11 +855,20 @@ void WebServer::eventLoop()
 
         if (timeout)
         {
-            utils.timer_handler();   // 时钟滴答一次，则执行一次定时处理任务，并重新计时
+            utils.timer_handler();   // 执行定时处理任务，并按最近的到期时间重新设置timerfd
 
             LOG_INFO("%s", "timer tick");    // log日志打印一次“时钟滴答”
 
             timeout = false;
         }
     }
+
+    // 通知所有子反应堆退出，并等待其线程结束
+    if (m_reactors)
+    {
+        for (int i = 0; i < m_reactor_num; ++i)
+            m_reactors[i].stop();
+        for (int i = 0; i < m_reactor_num; ++i)
+            m_reactors[i].join();
+    }
 }
\ No newline at end of file
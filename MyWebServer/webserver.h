@@ -14,10 +14,11 @@
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./reactor/sub_reactor.h"
+#include "./uring/uring.h"
 
 const int MAX_FD = 65536;            //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000;  //最大事件数
-const int TIMESLOT = 5;              //最小超时单位
 
 class WebServer
 {
@@ -27,21 +28,37 @@ public:
 
     void init(int port , string user, string passWord, string databaseName,
               int log_write , int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int reactor_num, int io_backend,
+              int header_timeout, int body_timeout, int idle_timeout, int write_timeout, int max_requests, int sendfile_threshold, int cache_size, string max_age);
 
     void thread_pool();
     void sql_pool();
     void log_write();
     void trig_mode();
     void eventListen();
+    void eventListenMulti();
+    void eventSignal();
+    bool eventListenUring();
     void eventLoop();
+    void eventLoopUring();
     void timer(int connfd, struct sockaddr_in client_address);
-    void adjust_timer(util_timer *timer);
+    void adjust_timer(int sockfd);
+    void log_expired();
+    void log_cache();
     void deal_timer(util_timer *timer, int sockfd);
     bool dealclinetdata();
-    bool dealwithsignal(bool& timeout, bool& stop_server);
+    bool dealwithsignal(bool& stop_server);
+    void dealwithcompletion();
+    void dealwithrequest(int sockfd);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
+    void uring_accept(int res, unsigned flags);
+    void uring_recv(int sockfd, int res, int bid);
+    void uring_send(int sockfd, int res);
+    void uring_submit_accept();
+    void uring_submit_recv(int sockfd, bool select = true);
+    void uring_submit_send(int sockfd);
+    void uring_submit_poll(int op, int fd);
 
 public:
     // 基础
@@ -49,9 +66,10 @@ public:
     char *m_root;      // root文件夹路径
     int m_log_write;   // 日志写入方式
     int m_close_log;   // 是否闭日志
-    int m_actormodel;  // 并发模式
+    int m_actormodel;  // 并发模式 (0: proactor, 1: reactor, 2: multi-reactor)
 
-    int m_pipefd[2];   // 双向管道
+    int m_signalfd;    // 接收SIGTERM、SIGHUP的signalfd
+    int m_timerfd;     // 驱动定时器容器的timerfd
     int m_epollfd;     // 内核事件表
     http_conn *users;  // http_conn对象数组
 
@@ -65,6 +83,8 @@ public:
     // 线程池相关
     threadpool<http_conn> *m_pool;   // 线程池
     int m_thread_num;                // 线程池中的线程数
+    int m_completionfd;              // 完成通知eventfd (reactor模式下工作线程处理完任务后唤醒主线程)
+    vector<completion> m_completions;   // 取出的完成通知 (复用，避免每次分配)
 
     // epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];
@@ -80,5 +100,19 @@ public:
     // 定时器相关
     client_data *users_timer;   // 关于定时器的客户数据数组
     Utils utils;                // 工具类
+
+    string m_max_age;           // 按路径前缀配置的Cache-Control max-age规则
+
+    // multi-reactor相关
+    sub_reactor *m_reactors;    // 子反应堆数组
+    int m_reactor_num;          // 子反应堆数量
+
+    // io_uring相关
+    int m_io_backend;                    // I/O后端 (0: epoll, 1: io_uring)
+    int m_timeout[TIMEOUT_TYPES];        // 各阶段的超时时间 (秒)
+    uring *m_uring;                      // io_uring实例 (为NULL表示使用epoll)
+    bool m_accept_multishot;             // 是否使用multishot accept (内核不支持时退化为每次accept重新提交)
+    struct sockaddr_in m_accept_addr;    // 单次accept时内核写入的客户端地址
+    socklen_t m_accept_addrlen;
 };
 #endif
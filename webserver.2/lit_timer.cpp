@@ -1,5 +1,10 @@
 #include "lit_timer.h"
 
+// 时间轮使用的时钟
+time_t lit_time() {
+    return time(NULL);
+}
+
 // 构造函数
 sort_timer_lst::sort_timer_lst() {
     head = NULL;
@@ -9,6 +9,7 @@
 #include <arpa/inet.h>
 #include <time.h>
 #include <sys/epoll.h>
+#include "../MyWebServer/timer/time_wheel.h"
 
 class util_timer;
 
@@ -50,6 +51,12 @@ public:
     util_timer* tail;   // 尾结点
 };
 
+// 时间轮使用的时钟 (与sort_timer_lst相同，以秒为单位)
+time_t lit_time();
+
+// 时间轮定时器容器 (与sort_timer_lst接口相同，添加、调整、删除均为O(1))
+typedef time_wheel<util_timer> wheel_timer_lst;
+
 
 
 # endif // !LST_TIMER_H
\ No newline at end of file
@@ -85,8 +85,8 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 
-    // 创建定时器容器
-    sort_timer_lst timer_lst;
+    // 创建定时器容器 (时间轮，刻度为1秒)
+    wheel_timer_lst timer_lst(lit_time);
 
     // 预先为每个可能的客户连接 分配一个http_conn对象
     http_conn* users = new http_conn[MAX_FD];